@@ -0,0 +1,135 @@
+package base
+
+import (
+	"context"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// admission control keeps a burst of masters from overloading the host a slave runs on
+// at most maxBatches batches run at once and at most queueDepth more wait for a slot, beyond
+// that batches are refused right away with StatusBusy and a retry-after hint
+// the slave runs the batches of a connection one after another, so all batches a connection
+// has queued share one reservation: a pipelining master is admitted once, not per batch
+// CommandExec processes are bounded separately across all batches, see SetExecLimit
+
+// MinRetryAfter is the smallest retry-after hint handed out
+const MinRetryAfter = 100 * time.Millisecond
+
+// Admission decides whether an incoming batch runs, waits or is refused
+type Admission struct {
+	slots      chan struct{} // one token per running batch
+	maxPending int64         // reservations, running plus waiting
+	pending    atomic.Int64
+
+	mu      sync.Mutex
+	avgTime time.Duration // moving average of batch run time
+}
+
+// NewAdmission allows maxBatches concurrent batches with queueDepth more waiting
+func NewAdmission(maxBatches, queueDepth int) *Admission {
+	return &Admission{
+		slots:      make(chan struct{}, maxBatches),
+		maxPending: int64(maxBatches + queueDepth),
+	}
+}
+
+// Reserve claims a place for a batch, running or queued
+// when the slave is full it returns false and how long the master should wait before retrying
+func (a *Admission) Reserve() (bool, time.Duration) {
+	if n := a.pending.Add(1); n > a.maxPending {
+		a.pending.Add(-1)
+		return false, a.retryAfter(n)
+	}
+	return true, 0
+}
+
+// Acquire waits for a run slot, the batch must hold a reservation
+// it gives up when ctx ends, the reservation is kept either way
+func (a *Admission) Acquire(ctx context.Context) error {
+	select {
+	case a.slots <- struct{}{}:
+		return nil
+	case <-ctx.Done():
+		return ctx.Err()
+	}
+}
+
+// Release frees the run slot of a batch that ran for elapsed
+func (a *Admission) Release(elapsed time.Duration) {
+	<-a.slots
+
+	a.mu.Lock()
+	if a.avgTime == 0 {
+		a.avgTime = elapsed
+	} else {
+		a.avgTime = (7*a.avgTime + elapsed) / 8
+	}
+	a.mu.Unlock()
+}
+
+// Unreserve drops a reservation once no batch holding it runs or waits anymore
+func (a *Admission) Unreserve() {
+	a.pending.Add(-1)
+}
+
+// retryAfter estimates when a slot frees up: the queue ahead drains cap(slots) batches per average run time
+func (a *Admission) retryAfter(pending int64) time.Duration {
+	a.mu.Lock()
+	avg := a.avgTime
+	a.mu.Unlock()
+
+	rounds := (pending - a.maxPending + int64(cap(a.slots)) - 1) / int64(cap(a.slots))
+	wait := time.Duration(rounds) * avg
+	if wait < MinRetryAfter {
+		wait = MinRetryAfter
+	}
+	return wait
+}
+
+// BusyResponse is the answer to a refused batch
+func BusyResponse(retryAfter time.Duration) BatchResponse {
+	return BatchResponse{
+		Status:       StatusBusy,
+		Error:        "slave is busy, retry later",
+		RetryAfterMs: retryAfter.Milliseconds(),
+	}
+}
+
+// QueueFullResponse is the answer to a batch refused because its connection already has
+// ConnQueueDepth batches queued, the master retries it without counting it as busy
+func QueueFullResponse() BatchResponse {
+	return BatchResponse{
+		Status:       StatusQueueFull,
+		Error:        "connection queue is full, retry later",
+		RetryAfterMs: MinRetryAfter.Milliseconds(),
+	}
+}
+
+// execSlots bounds the CommandExec processes running at once, nil means no bound
+var execSlots chan struct{}
+
+// SetExecLimit bounds the shell commands running at once across all batches, 0 removes the bound
+func SetExecLimit(n int) {
+	if n <= 0 {
+		execSlots = nil
+		return
+	}
+	execSlots = make(chan struct{}, n)
+}
+
+// acquireExec waits for an exec slot and returns the function releasing it
+func acquireExec(ctx context.Context) (func(), error) {
+	slots := execSlots
+	if slots == nil {
+		return func() {}, nil
+	}
+
+	select {
+	case slots <- struct{}{}:
+		return func() { <-slots }, nil
+	case <-ctx.Done():
+		return nil, ctx.Err()
+	}
+}
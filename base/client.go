@@ -0,0 +1,444 @@
+package base
+
+import (
+	"context"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io"
+	"net"
+	"sync"
+	"time"
+)
+
+// ErrClientClosed is returned for calls on a closed or broken slave connection
+var ErrClientClosed = errors.New("slave connection closed")
+
+// maxBusyRetries is how often Wait resends a batch the slave refused as busy
+const maxBusyRetries = 5
+
+// call represents an in-flight batch on a slave connection
+type Call struct {
+	ID       uint64
+	Response BatchResponse
+	Error    error
+	Done     chan *Call
+
+	StreamHandlers
+
+	rawErr error        // first failure writing raw bytes, reported once the response arrives
+	resend func() *Call // sends the batch again, nil when it can't be
+}
+
+// streamHandlers receive the streamed output of a batch, both are called from the connection's read goroutine
+type StreamHandlers struct {
+	// OnChunk receives streamed output of command index, data must not be retained after it returns
+	OnChunk func(index int, data []byte)
+
+	// OnRaw returns where raw file bytes of command index go, an *os.File receives them by splice
+	// without OnRaw they are handed to OnChunk
+	OnRaw func(index int) io.Writer
+}
+
+// chunkFunc adapts a chunk callback to an io.Writer
+type chunkFunc func(data []byte)
+
+func (fn chunkFunc) Write(p []byte) (int, error) {
+	fn(p)
+	return len(p), nil
+}
+
+// rawWriter returns the destination for raw bytes of command index
+func (call *Call) rawWriter(index int) io.Writer {
+	if call.OnRaw != nil {
+		if w := call.OnRaw(index); w != nil {
+			return w
+		}
+	}
+	if call.OnChunk != nil {
+		return chunkFunc(func(data []byte) { call.OnChunk(index, data) })
+	}
+	return io.Discard
+}
+
+// slaveClient is a long-lived, pipelined connection to a slave
+// many batches may be in flight at once, responses are matched by request id
+// at most ConnQueueDepth batches are unanswered, sending more waits for a response
+type SlaveClient struct {
+	fc   *FrameConn
+	caps uint32 // capabilities agreed on with the slave
+
+	window chan struct{} // one token per unanswered batch, abandoned ones included
+	broken chan struct{} // closed once the read loop stopped
+
+	mu         sync.Mutex
+	nextID     uint64
+	pending    map[uint64]*Call
+	unanswered map[uint64]struct{} // ids holding a window token
+	err        error               // set once the connection is broken
+}
+
+// DialSlave connects to a slave at addr asking for every capability this build supports
+func DialSlave(addr string, timeout time.Duration) (*SlaveClient, error) {
+	return DialSlaveWithCaps(addr, timeout, SupportedCaps)
+}
+
+// DialSlaveWithCaps connects to a slave at addr, negotiates caps and starts reading responses
+func DialSlaveWithCaps(addr string, timeout time.Duration, caps uint32) (*SlaveClient, error) {
+	conn, err := net.DialTimeout("tcp", addr, timeout)
+	if err != nil {
+		return nil, fmt.Errorf("failed to connect to slave at %s: %w", addr, err)
+	}
+
+	c := &SlaveClient{
+		fc:         NewFrameConn(conn),
+		window:     make(chan struct{}, ConnQueueDepth),
+		broken:     make(chan struct{}),
+		pending:    make(map[uint64]*Call),
+		unanswered: make(map[uint64]struct{}),
+	}
+
+	if c.caps, err = c.hello(caps, timeout); err != nil {
+		conn.Close()
+		return nil, fmt.Errorf("failed to negotiate with slave at %s: %w", addr, err)
+	}
+
+	go c.readLoop()
+	return c, nil
+}
+
+// hello announces the wanted capabilities and returns the ones the slave agreed to
+func (c *SlaveClient) hello(caps uint32, timeout time.Duration) (uint32, error) {
+	if err := c.fc.WriteFrame(EncodeHello(caps)); err != nil {
+		return 0, err
+	}
+
+	if timeout > 0 {
+		c.fc.conn.SetReadDeadline(time.Now().Add(timeout))
+		defer c.fc.conn.SetReadDeadline(time.Time{})
+	}
+
+	f, err := c.fc.ReadFrame()
+	if err != nil {
+		return 0, err
+	}
+	agreed, err := DecodeHello(f)
+	if err != nil {
+		return 0, err
+	}
+
+	// never trust the slave to grant more than we asked for
+	agreed &= caps
+	c.fc.SetCaps(agreed)
+	return agreed, nil
+}
+
+// Caps returns the capabilities agreed on with the slave
+func (c *SlaveClient) Caps() uint32 {
+	return c.caps
+}
+
+// Err returns why the connection can't be used anymore, nil while it is healthy
+func (c *SlaveClient) Err() error {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	return c.err
+}
+
+// readLoop dispatches response frames to their pending calls
+func (c *SlaveClient) readLoop() {
+	var err error
+	for {
+		var f Frame
+		f, err = c.fc.ReadFrame()
+		if err != nil {
+			break
+		}
+
+		if f.Type == FrameRaw {
+			c.mu.Lock()
+			call := c.pending[f.ID]
+			c.mu.Unlock()
+
+			index, _, _ := ParseChunk(f.Payload)
+			var dst io.Writer = io.Discard
+			if call != nil {
+				dst = call.rawWriter(index)
+			}
+
+			var werr error
+			werr, err = c.fc.ReadRaw(dst, f.RawLen)
+			if err != nil {
+				break
+			}
+			if werr != nil && call != nil && call.rawErr == nil {
+				call.rawErr = fmt.Errorf("could not store raw output of command %d: %w", index+1, werr)
+			}
+			continue
+		}
+
+		if f.Type == FrameChunk {
+			c.mu.Lock()
+			call := c.pending[f.ID]
+			c.mu.Unlock()
+
+			if call != nil && call.OnChunk != nil {
+				if err = deliverChunk(call, f); err != nil {
+					break
+				}
+			}
+			continue
+		}
+
+		c.mu.Lock()
+		call := c.pending[f.ID]
+		delete(c.pending, f.ID)
+		_, holdsToken := c.unanswered[f.ID]
+		delete(c.unanswered, f.ID)
+		c.mu.Unlock()
+
+		if holdsToken {
+			<-c.window
+		}
+		if call == nil {
+			continue // response to a call nobody waits for anymore
+		}
+
+		switch f.Type {
+		case FrameBatchResponse:
+			if uerr := decodeResponse(f, &call.Response); uerr != nil {
+				call.Error = fmt.Errorf("failed to unmarshal response from slave: %w", uerr)
+			}
+		default:
+			call.Error = fmt.Errorf("unexpected frame type %d from slave", f.Type)
+		}
+		if call.Error == nil {
+			call.Error = call.rawErr
+		}
+		call.Done <- call
+	}
+
+	// fail everything still in flight, the stream can't be trusted past this point
+	c.fc.Close()
+	c.mu.Lock()
+	if c.err == nil {
+		c.err = fmt.Errorf("%w: %v", ErrClientClosed, err)
+	}
+	pending := c.pending
+	c.pending = make(map[uint64]*Call)
+	c.mu.Unlock()
+	close(c.broken) // senders waiting for the window give up
+
+	for _, call := range pending {
+		call.Error = c.err
+		call.Done <- call
+	}
+}
+
+// deliverChunk hands the output of a chunk frame to the call, inflating compressed output piecewise
+func deliverChunk(call *Call, f Frame) error {
+	index, data, err := ParseChunk(f.Payload)
+	if err != nil {
+		return err
+	}
+
+	if f.Flags&FlagCompressed == 0 {
+		call.OnChunk(index, data)
+		return nil
+	}
+
+	r, err := NewPayloadReader(f, data)
+	if err != nil {
+		return fmt.Errorf("could not inflate chunk: %w", err)
+	}
+	if _, err := io.Copy(chunkFunc(func(data []byte) { call.OnChunk(index, data) }), r); err != nil {
+		return fmt.Errorf("could not inflate chunk: %w", err)
+	}
+	return nil
+}
+
+// decodeResponse decodes a response frame in whatever encoding and compression it uses
+// compressed json is decoded straight from the inflating reader
+func decodeResponse(f Frame, resp *BatchResponse) error {
+	if f.Flags&FlagBinary != 0 {
+		payload, err := inflate(f, f.Payload)
+		if err != nil {
+			return err
+		}
+		return DecodeBatchResponse(payload, resp)
+	}
+
+	if f.Flags&FlagCompressed == 0 {
+		return json.Unmarshal(f.Payload, resp)
+	}
+
+	r, err := NewPayloadReader(f, f.Payload)
+	if err != nil {
+		return err
+	}
+	return json.NewDecoder(r).Decode(resp)
+}
+
+// Go sends a batch with the given frame flags without waiting for its response, unless
+// ConnQueueDepth batches are unanswered already; the returned call's Done channel receives the call once the response arrives
+func (c *SlaveClient) Go(batchJSON []byte, flags byte) *Call {
+	return c.GoStream(batchJSON, flags, StreamHandlers{})
+}
+
+// GoStream is Go with handlers for streamed output, meant to be used with FlagStream
+// batchJSON must not be modified until the call is done, Wait may send it again
+func (c *SlaveClient) GoStream(batchJSON []byte, flags byte, handlers StreamHandlers) *Call {
+	call := c.send(batchJSON, flags, handlers)
+	call.resend = func() *Call { return c.GoStream(batchJSON, flags, handlers) }
+	return call
+}
+
+// send writes a batch frame and registers its call
+// with ConnQueueDepth batches unanswered it first waits for a response, the slave's queue for
+// the connection would be full otherwise
+func (c *SlaveClient) send(payload []byte, flags byte, handlers StreamHandlers) *Call {
+	call := &Call{Done: make(chan *Call, 1), StreamHandlers: handlers}
+
+	select {
+	case c.window <- struct{}{}:
+	case <-c.broken:
+		call.Error = c.Err()
+		call.Done <- call
+		return call
+	}
+
+	c.mu.Lock()
+	if c.err != nil {
+		c.mu.Unlock()
+		<-c.window
+		call.Error = c.err
+		call.Done <- call
+		return call
+	}
+	c.nextID++
+	call.ID = c.nextID
+	c.pending[call.ID] = call
+	c.unanswered[call.ID] = struct{}{}
+	c.mu.Unlock()
+
+	if err := c.fc.WriteFrame(Frame{ID: call.ID, Type: FrameBatch, Flags: flags, Payload: payload}); err != nil {
+		c.mu.Lock()
+		_, stillPending := c.pending[call.ID]
+		delete(c.pending, call.ID)
+		if _, ok := c.unanswered[call.ID]; ok {
+			delete(c.unanswered, call.ID)
+			<-c.window
+		}
+		c.mu.Unlock()
+
+		// the read loop may have already failed this call
+		if stillPending {
+			call.Error = fmt.Errorf("failed to send batch to slave: %w", err)
+			call.Done <- call
+		}
+	}
+
+	return call
+}
+
+// GoBatch encodes batch, with the binary codec if the slave agreed to it, and sends it like Go
+// batch must not be modified until the call is done, Wait may send it again
+func (c *SlaveClient) GoBatch(batch *Batch, flags byte) *Call {
+	return c.GoBatchStream(batch, flags, StreamHandlers{})
+}
+
+// GoBatchStream is GoBatch with handlers for streamed output, meant to be used with FlagStream
+func (c *SlaveClient) GoBatchStream(batch *Batch, flags byte, handlers StreamHandlers) *Call {
+	var call *Call
+	if c.caps&CapBinary == 0 {
+		data, err := json.Marshal(batch)
+		if err != nil {
+			call := &Call{Done: make(chan *Call, 1), Error: fmt.Errorf("could not marshal batch: %w", err)}
+			call.Done <- call
+			return call
+		}
+		call = c.send(data, flags, handlers)
+	} else {
+		// the frame is written before send returns, so the buffer can go straight back to the pool,
+		// a resend encodes the batch again
+		buf := GetBuffer()
+		*buf = AppendBatch(*buf, batch)
+		call = c.send(*buf, flags|FlagBinary, handlers)
+		PutBuffer(buf)
+	}
+
+	call.resend = func() *Call { return c.GoBatchStream(batch, flags, handlers) }
+	return call
+}
+
+// Cancel asks the slave to stop a batch, commands still running are killed and the ones
+// not started yet fail; the response, if it is still awaited, reports them
+func (c *SlaveClient) Cancel(call *Call) {
+	c.fc.WriteFrame(Frame{ID: call.ID, Type: FrameCancel})
+}
+
+// Abandon stops waiting for call and asks the slave to stop it, output and response still
+// arriving for it are dropped and its Done channel never receives
+func (c *SlaveClient) Abandon(call *Call) {
+	c.mu.Lock()
+	delete(c.pending, call.ID)
+	c.mu.Unlock()
+	c.Cancel(call)
+}
+
+// Do sends a batch and waits for its response
+func (c *SlaveClient) Do(ctx context.Context, batchJSON []byte, flags byte) (BatchResponse, error) {
+	return c.DoStream(ctx, batchJSON, flags, StreamHandlers{})
+}
+
+// DoStream sends a batch, hands streamed output to handlers and waits for the final response like Wait
+func (c *SlaveClient) DoStream(ctx context.Context, batchJSON []byte, flags byte, handlers StreamHandlers) (BatchResponse, error) {
+	return c.Wait(ctx, c.GoStream(batchJSON, flags, handlers))
+}
+
+// Wait waits for the response of call, every way of sending a batch ends up here
+// a batch refused with StatusBusy is sent again after the slave's retry-after hint,
+// up to maxBusyRetries times and as long as ctx allows; one refused with StatusQueueFull is
+// sent again without counting against that budget; when ctx ends first, the slave is told
+// to stop the batch and ctx's error is returned
+func (c *SlaveClient) Wait(ctx context.Context, call *Call) (BatchResponse, error) {
+	busyRetries := 0
+	for {
+		select {
+		case <-call.Done:
+		case <-ctx.Done():
+			c.Abandon(call)
+			return BatchResponse{}, ctx.Err()
+		}
+
+		if call.Error != nil || call.resend == nil {
+			return call.Response, call.Error
+		}
+		switch {
+		case call.Response.Status == StatusQueueFull:
+		case call.Response.Status == StatusBusy && busyRetries < maxBusyRetries:
+			busyRetries++
+		default:
+			return call.Response, nil
+		}
+
+		timer := time.NewTimer(time.Duration(call.Response.RetryAfterMs) * time.Millisecond)
+		select {
+		case <-timer.C:
+		case <-ctx.Done():
+			timer.Stop()
+			return BatchResponse{}, ctx.Err()
+		}
+		call = call.resend()
+	}
+}
+
+// Close closes the connection, failing all in-flight calls
+func (c *SlaveClient) Close() error {
+	c.mu.Lock()
+	if c.err == nil {
+		c.err = ErrClientClosed
+	}
+	c.mu.Unlock()
+	return c.fc.Close()
+}
@@ -0,0 +1,222 @@
+package base
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"sync"
+)
+
+// binary encoding of batches and batch responses, used instead of json on connections
+// that negotiated CapBinary; no reflection and no escaping of output data
+//
+// every encoding starts with codecVersion, then
+//   string   = uvarint length | bytes
+//   batch    = uvarint count | count * (string name | uvarint argc | argc * string |
+//              uvarint depc | (depc - 1) * uvarint dep | varint timeout ms)
+//              depc 0 means no depends_on
+//   response = varint status | string error | varint retry after ms | uvarint count |
+//              count * (string data | string error | varint status)
+
+const codecVersion = 3
+
+var errShortBuffer = errors.New("binary payload is truncated")
+
+// codecBuffers recycles encoding buffers between frames
+var codecBuffers = sync.Pool{
+	New: func() any {
+		buf := make([]byte, 0, 64<<10)
+		return &buf
+	},
+}
+
+// maxPooledBuffer keeps one huge response from pinning its buffer forever
+const maxPooledBuffer = 4 << 20
+
+// GetBuffer returns an empty buffer from the encoding pool
+func GetBuffer() *[]byte {
+	buf := codecBuffers.Get().(*[]byte)
+	*buf = (*buf)[:0]
+	return buf
+}
+
+// PutBuffer hands a buffer back to the encoding pool
+func PutBuffer(buf *[]byte) {
+	if cap(*buf) <= maxPooledBuffer {
+		codecBuffers.Put(buf)
+	}
+}
+
+func appendString(dst []byte, s string) []byte {
+	dst = binary.AppendUvarint(dst, uint64(len(s)))
+	return append(dst, s...)
+}
+
+// AppendBatch appends the binary encoding of b to dst
+func AppendBatch(dst []byte, b *Batch) []byte {
+	dst = append(dst, codecVersion)
+	dst = binary.AppendUvarint(dst, uint64(len(b.Commands)))
+	for i := range b.Commands {
+		cmd := &b.Commands[i]
+		dst = appendString(dst, cmd.Name)
+		dst = binary.AppendUvarint(dst, uint64(len(cmd.Args)))
+		for _, arg := range cmd.Args {
+			dst = appendString(dst, arg)
+		}
+
+		if cmd.DependsOn == nil {
+			dst = binary.AppendUvarint(dst, 0)
+		} else {
+			dst = binary.AppendUvarint(dst, uint64(len(cmd.DependsOn))+1)
+			for _, dep := range cmd.DependsOn {
+				dst = binary.AppendUvarint(dst, uint64(dep))
+			}
+		}
+		dst = binary.AppendVarint(dst, cmd.TimeoutMs)
+	}
+	return dst
+}
+
+// AppendBatchResponse appends the binary encoding of r to dst
+func AppendBatchResponse(dst []byte, r *BatchResponse) []byte {
+	dst = append(dst, codecVersion)
+	dst = binary.AppendVarint(dst, int64(r.Status))
+	dst = appendString(dst, r.Error)
+	dst = binary.AppendVarint(dst, r.RetryAfterMs)
+	dst = binary.AppendUvarint(dst, uint64(len(r.Results)))
+	for i := range r.Results {
+		result := &r.Results[i]
+		dst = appendString(dst, result.Data)
+		dst = appendString(dst, result.Error)
+		dst = binary.AppendVarint(dst, int64(result.Status))
+	}
+	return dst
+}
+
+// decoder walks a binary payload
+type decoder struct {
+	data []byte
+	err  error
+}
+
+func (d *decoder) uvarint() uint64 {
+	if d.err != nil {
+		return 0
+	}
+	v, n := binary.Uvarint(d.data)
+	if n <= 0 {
+		d.err = errShortBuffer
+		return 0
+	}
+	d.data = d.data[n:]
+	return v
+}
+
+func (d *decoder) varint() int64 {
+	if d.err != nil {
+		return 0
+	}
+	v, n := binary.Varint(d.data)
+	if n <= 0 {
+		d.err = errShortBuffer
+		return 0
+	}
+	d.data = d.data[n:]
+	return v
+}
+
+func (d *decoder) string() string {
+	n := d.uvarint()
+	if d.err != nil {
+		return ""
+	}
+	if n > uint64(len(d.data)) {
+		d.err = errShortBuffer
+		return ""
+	}
+	s := string(d.data[:n])
+	d.data = d.data[n:]
+	return s
+}
+
+// count reads an element count, every element takes at least one byte
+func (d *decoder) count() int {
+	n := d.uvarint()
+	if n > uint64(len(d.data)) {
+		d.err = errShortBuffer
+		return 0
+	}
+	return int(n)
+}
+
+func (d *decoder) version() {
+	if len(d.data) == 0 {
+		d.err = errShortBuffer
+		return
+	}
+	if d.data[0] != codecVersion {
+		d.err = fmt.Errorf("unsupported binary encoding version %d", d.data[0])
+		return
+	}
+	d.data = d.data[1:]
+}
+
+// DecodeBatch decodes a binary batch into b, reusing its command slice
+func DecodeBatch(data []byte, b *Batch) error {
+	d := decoder{data: data}
+	d.version()
+
+	n := d.count()
+	b.Commands = b.Commands[:0]
+	for i := 0; i < n && d.err == nil; i++ {
+		var cmd Command
+		cmd.Name = d.string()
+
+		argc := d.count()
+		if argc > 0 {
+			cmd.Args = make([]string, argc)
+			for j := range cmd.Args {
+				cmd.Args[j] = d.string()
+			}
+		}
+
+		if depc := d.count(); depc > 0 {
+			cmd.DependsOn = make([]int, depc-1)
+			for j := range cmd.DependsOn {
+				cmd.DependsOn[j] = int(d.uvarint())
+			}
+		}
+		cmd.TimeoutMs = d.varint()
+		b.Commands = append(b.Commands, cmd)
+	}
+
+	if d.err != nil {
+		return fmt.Errorf("could not decode batch: %w", d.err)
+	}
+	return nil
+}
+
+// DecodeBatchResponse decodes a binary batch response into r, reusing its result slice
+func DecodeBatchResponse(data []byte, r *BatchResponse) error {
+	d := decoder{data: data}
+	d.version()
+
+	r.Status = int(d.varint())
+	r.Error = d.string()
+	r.RetryAfterMs = d.varint()
+
+	n := d.count()
+	r.Results = r.Results[:0]
+	for i := 0; i < n && d.err == nil; i++ {
+		var result Response
+		result.Data = d.string()
+		result.Error = d.string()
+		result.Status = int(d.varint())
+		r.Results = append(r.Results, result)
+	}
+
+	if d.err != nil {
+		return fmt.Errorf("could not decode batch response: %w", d.err)
+	}
+	return nil
+}
@@ -0,0 +1,176 @@
+package base
+
+import (
+	"reflect"
+	"strings"
+	"testing"
+)
+
+func testBatch() *Batch {
+	return &Batch{Commands: []Command{
+		{Name: "ReadFile", Args: []string{"/etc/hostname", "last_lines=10"}},
+		{Name: "CommandExec", Args: []string{"echo 'ü\x00'"}, DependsOn: []int{0}, TimeoutMs: 1500},
+		{Name: "ListDir", Args: nil},
+		{Name: "Stat", Args: []string{""}, DependsOn: []int{}, TimeoutMs: -1},
+		{Name: "Glob", Args: []string{"/var/log/*.log"}, DependsOn: []int{0, 1, 300}},
+		{Name: "WriteFile", Args: []string{"/tmp/out", strings.Repeat("compressible content\n", 1000)}},
+	}}
+}
+
+func testResponse() *BatchResponse {
+	return &BatchResponse{
+		Status:       StatusError,
+		Error:        "",
+		RetryAfterMs: 250,
+		Results: []Response{
+			{Data: "hello\n", Status: StatusOK},
+			{Error: "file not found", Status: StatusError},
+			{Data: strings.Repeat("compressible output line\n", 2000), Status: StatusOK},
+			{},
+		},
+	}
+}
+
+func TestBatchRoundTrip(t *testing.T) {
+	want := testBatch()
+	data := AppendBatch(nil, want)
+
+	for _, compressed := range []bool{false, true} {
+		payload := data
+		f := Frame{Type: FrameBatch, Flags: FlagBinary}
+		if compressed {
+			var ok bool
+			if payload, ok = compress(data); !ok {
+				t.Fatal("batch did not compress")
+			}
+			f.Flags |= FlagCompressed
+		}
+
+		raw, err := inflate(f, payload)
+		if err != nil {
+			t.Fatalf("compressed=%v: inflate: %v", compressed, err)
+		}
+		var got Batch
+		if err := DecodeBatch(raw, &got); err != nil {
+			t.Fatalf("compressed=%v: decode: %v", compressed, err)
+		}
+		if !reflect.DeepEqual(&got, want) {
+			t.Fatalf("compressed=%v: got %+v, want %+v", compressed, got, *want)
+		}
+	}
+}
+
+func TestBatchEmptySlices(t *testing.T) {
+	// no args decodes as nil however it was sent, depends_on keeps nil and empty apart
+	batch := &Batch{Commands: []Command{
+		{Name: "a", Args: []string{}, DependsOn: nil},
+		{Name: "b", Args: nil, DependsOn: []int{}},
+	}}
+
+	var got Batch
+	if err := DecodeBatch(AppendBatch(nil, batch), &got); err != nil {
+		t.Fatal(err)
+	}
+	if got.Commands[0].Args != nil || got.Commands[1].Args != nil {
+		t.Errorf("empty args decoded as %#v and %#v, want nil", got.Commands[0].Args, got.Commands[1].Args)
+	}
+	if got.Commands[0].DependsOn != nil {
+		t.Errorf("nil depends_on decoded as %#v", got.Commands[0].DependsOn)
+	}
+	if got.Commands[1].DependsOn == nil || len(got.Commands[1].DependsOn) != 0 {
+		t.Errorf("empty depends_on decoded as %#v", got.Commands[1].DependsOn)
+	}
+}
+
+func TestBatchResponseRoundTrip(t *testing.T) {
+	want := testResponse()
+	data := AppendBatchResponse(nil, want)
+
+	for _, compressed := range []bool{false, true} {
+		f := Frame{Type: FrameBatchResponse, Flags: FlagBinary, Payload: data}
+		if compressed {
+			payload, ok := compress(data)
+			if !ok {
+				t.Fatal("response did not compress")
+			}
+			f.Payload = payload
+			f.Flags |= FlagCompressed
+		}
+
+		var got BatchResponse
+		if err := decodeResponse(f, &got); err != nil {
+			t.Fatalf("compressed=%v: decode: %v", compressed, err)
+		}
+		if !reflect.DeepEqual(&got, want) {
+			t.Fatalf("compressed=%v: round trip changed the response", compressed)
+		}
+	}
+}
+
+func TestDecodeReusesSlices(t *testing.T) {
+	got := BatchResponse{Results: make([]Response, 10)}
+	if err := DecodeBatchResponse(AppendBatchResponse(nil, &BatchResponse{Results: []Response{{Data: "x"}}}), &got); err != nil {
+		t.Fatal(err)
+	}
+	if len(got.Results) != 1 || got.Results[0].Data != "x" {
+		t.Fatalf("got %+v", got.Results)
+	}
+}
+
+func TestDecodeTruncated(t *testing.T) {
+	batch := AppendBatch(nil, testBatch())
+	response := AppendBatchResponse(nil, testResponse())
+
+	// every strict prefix of a valid encoding misses a field
+	for n := 0; n < len(batch); n++ {
+		var b Batch
+		if err := DecodeBatch(batch[:n], &b); err == nil {
+			t.Fatalf("batch truncated to %d of %d bytes decoded without error", n, len(batch))
+		}
+	}
+	for n := 0; n < len(response); n++ {
+		var r BatchResponse
+		if err := DecodeBatchResponse(response[:n], &r); err == nil {
+			t.Fatalf("response truncated to %d of %d bytes decoded without error", n, len(response))
+		}
+	}
+}
+
+func TestDecodeMalformed(t *testing.T) {
+	tests := []struct {
+		name   string
+		decode func([]byte) error
+		data   []byte
+	}{
+		{"batch empty", decodeBatch, nil},
+		{"batch wrong version", decodeBatch, []byte{codecVersion + 1, 0}},
+		{"batch huge command count", decodeBatch, []byte{codecVersion, 0xff, 0xff, 0xff, 0xff, 0x0f}},
+		{"batch huge name length", decodeBatch, []byte{codecVersion, 1, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f}},
+		{"batch huge arg count", decodeBatch, []byte{codecVersion, 1, 1, 'a', 0xff, 0xff, 0xff, 0x7f}},
+		{"batch huge depends count", decodeBatch, []byte{codecVersion, 1, 1, 'a', 0, 0xff, 0xff, 0xff, 0x7f}},
+		{"batch overlong varint", decodeBatch, []byte{codecVersion, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01}},
+		{"response empty", decodeResponseBytes, nil},
+		{"response wrong version", decodeResponseBytes, []byte{codecVersion + 1, 0, 0, 0, 0}},
+		{"response huge error length", decodeResponseBytes, []byte{codecVersion, 0, 0xff, 0xff, 0xff, 0x7f}},
+		{"response huge result count", decodeResponseBytes, []byte{codecVersion, 0, 0, 0, 0xff, 0xff, 0xff, 0x7f}},
+		{"response huge data length", decodeResponseBytes, []byte{codecVersion, 0, 0, 0, 1, 0xff, 0xff, 0xff, 0x7f}},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			if err := tt.decode(tt.data); err == nil {
+				t.Errorf("decoded without error")
+			}
+		})
+	}
+}
+
+func decodeBatch(data []byte) error {
+	var b Batch
+	return DecodeBatch(data, &b)
+}
+
+func decodeResponseBytes(data []byte) error {
+	var r BatchResponse
+	return DecodeBatchResponse(data, &r)
+}
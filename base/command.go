@@ -1,24 +1,39 @@
 package base
 
 import (
+	"bytes"
+	"context"
+	"errors"
 	"fmt"
 	"io"
+	"io/fs"
 	"os"
 	"os/exec"
 	"os/user"
+	"path/filepath"
 	"runtime"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
 )
 
 // status constants for command execution
 const (
 	StatusOK    = 0
 	StatusError = -1
+	StatusBusy  = -2 // the slave refused the batch, retry after RetryAfterMs
+
+	StatusQueueFull = -3 // the connection's queue on the slave was full, retry after RetryAfterMs
 )
 
 // command represents a single executable command
 type Command struct {
-	Name string   `json:"name"`
-	Args []string `json:"args"`
+	Name      string   `json:"name"`
+	Args      []string `json:"args"`
+	DependsOn []int    `json:"depends_on,omitempty"` // indices of earlier commands this one waits for in parallel batches
+	TimeoutMs int64    `json:"timeout_ms,omitempty"` // time limit for this command, 0 for none
 }
 
 // response represents the result of command execution
@@ -37,10 +52,13 @@ type Batch struct {
 type BatchResponse struct {
 	Results []Response `json:"results"`
 	Status  int        `json:"status"`
+	Error   string     `json:"error,omitempty"` // set when the batch itself could not be run
+
+	RetryAfterMs int64 `json:"retry_after_ms,omitempty"` // with StatusBusy and StatusQueueFull, when to try again
 }
 
 // primitiveFunc defines the signature for primitive functions
-type primitiveFunc func(args []string) (string, error)
+type primitiveFunc func(ctx context.Context, args []string) (string, error)
 
 // primitiveRegistry holds all available primitives
 var primitiveRegistry = map[string]primitiveFunc{
@@ -50,22 +68,35 @@ var primitiveRegistry = map[string]primitiveFunc{
 	"WriteFile":   writeFile,
 	"AppendFile":  appendFile,
 	"CommandExec": commandExec,
+	"ListDir":     listDir,
+	"Stat":        statPath,
+	"Grep":        grepPath,
+	"Head":        headFile,
+	"Tail":        tailFile,
+	"DiskUsage":   diskUsage,
+	"Glob":        globPaths,
+	"WalkTree":    walkTree,
 	// new primitives here
 }
 
-func commandExec(args []string) (string, error) {
-	if len(args) != 1 {
-		return "", fmt.Errorf("Command requires exactly one argument (command to execute)")
+func commandExec(ctx context.Context, args []string) (string, error) {
+	release, err := acquireExec(ctx)
+	if err != nil {
+		return "", err
 	}
+	defer release()
 
-	command := args[0]
-	if command == "" {
-		return "", fmt.Errorf("command cannot be empty")
+	if pool := shellPool; pool != nil {
+		return pooledCommandExec(ctx, pool, args)
 	}
 
-	cmd := exec.Command("/bin/bash", "-c", command)
-	out, err := cmd.CombinedOutput()
+	cmd, command, err := shellCommand(ctx, args)
 	if err != nil {
+		return "", err
+	}
+
+	out, err := cmd.CombinedOutput()
+	if err != nil && !detachedOutput(err) {
 		return "", fmt.Errorf("could not execute command %s: %w", command, err)
 	}
 
@@ -76,7 +107,45 @@ func commandExec(args []string) (string, error) {
 	return string(out), nil
 }
 
-func appendFile(args []string) (string, error) {
+// shellCommand validates CommandExec arguments and builds the shell invocation
+// when ctx ends the shell is killed together with everything it started
+func shellCommand(ctx context.Context, args []string) (*exec.Cmd, string, error) {
+	command, err := commandArg(args)
+	if err != nil {
+		return nil, "", err
+	}
+
+	cmd := exec.CommandContext(ctx, "/bin/bash", "-c", command)
+	setProcessGroup(cmd)
+	cmd.Cancel = func() error {
+		return killProcessGroup(cmd.Process)
+	}
+	// don't wait forever for output pipes held open by background processes
+	cmd.WaitDelay = time.Second
+
+	return cmd, command, nil
+}
+
+// detachedOutput reports whether err only says that the shell exited fine but something
+// it left running in the background still holds its output open
+func detachedOutput(err error) bool {
+	return errors.Is(err, exec.ErrWaitDelay)
+}
+
+// commandArg validates CommandExec arguments and returns the command line
+func commandArg(args []string) (string, error) {
+	if len(args) != 1 {
+		return "", fmt.Errorf("Command requires exactly one argument (command to execute)")
+	}
+
+	if args[0] == "" {
+		return "", fmt.Errorf("command cannot be empty")
+	}
+
+	return args[0], nil
+}
+
+func appendFile(ctx context.Context, args []string) (string, error) {
 	if len(args) != 2 {
 		return "", fmt.Errorf("AppendFile requires exactly two arguments, filepath an contents")
 	}
@@ -94,21 +163,14 @@ func appendFile(args []string) (string, error) {
 		}
 	}
 
-	file, err := os.OpenFile(filepath, os.O_APPEND|os.O_WRONLY, 0644) // wont create file it it doesn't exist (still takes the third argument)
-	if err != nil {
-		return "", fmt.Errorf("could not open file %s: %w", filepath, err)
-	}
-	defer file.Close()
-
-	_, err = file.WriteString(args[1])
-	if err != nil {
-		return "", fmt.Errorf("could not append to file %s: %w", filepath, err)
+	if err := appendTo(filepath, [][]byte{[]byte(args[1])}); err != nil {
+		return "", err
 	}
 
 	return "Appended Successfully", nil
 }
 
-func deleteFile(args []string) (string, error) {
+func deleteFile(ctx context.Context, args []string) (string, error) {
 	if len(args) != 1 {
 		return "", fmt.Errorf("DeleteFile requires exactly one argument (file path)")
 	}
@@ -146,7 +208,7 @@ func expandPath(path string) (string, error) {
 	return path, nil
 }
 
-func createFile(args []string) (string, error) {
+func createFile(ctx context.Context, args []string) (string, error) {
 	if len(args) != 1 {
 		return "", fmt.Errorf("CreateFile requires exactly one argument(file path)")
 	}
@@ -169,7 +231,7 @@ func createFile(args []string) (string, error) {
 	return fmt.Sprintf("File %s created successfully", filepath), nil
 }
 
-func writeFile(args []string) (string, error) {
+func writeFile(ctx context.Context, args []string) (string, error) {
 	if len(args) != 2 {
 		return "", fmt.Errorf("writeFile requires exactly two arguments (file path and content)")
 	}
@@ -187,6 +249,13 @@ func writeFile(args []string) (string, error) {
 		return "", fmt.Errorf("file path cannot be empty")
 	}
 
+	if writePolicy.atomic {
+		if err := replaceFile(filepath, content); err != nil {
+			return "", err
+		}
+		return "File written successfully", nil
+	}
+
 	file, err := os.OpenFile(filepath, os.O_WRONLY, 0644) // wont create file it it doesn't exist (still takes the third argument)
 	if err != nil {
 		return "", fmt.Errorf("could not open file %s: %w", filepath, err)
@@ -198,40 +267,246 @@ func writeFile(args []string) (string, error) {
 		return "", fmt.Errorf("could not write to file %s: %w", filepath, err)
 	}
 
+	if err := syncFile(file); err != nil {
+		return "", fmt.Errorf("could not sync file %s: %w", filepath, err)
+	}
+
 	return "File written successfully", nil
 }
 
-// readFile primitive - reads entire file contents
-func readFile(args []string) (string, error) {
+// readFile primitive - reads file contents, all of them or the range given after the path
+func readFile(ctx context.Context, args []string) (string, error) {
+	if tail, ok, err := readPseudoTail(ctx, args); ok {
+		return string(tail), err
+	}
+
+	file, filepath, n, err := openRange(args)
+	if err != nil {
+		return "", err
+	}
+	defer file.Close()
+
+	data, err := io.ReadAll(ctxReader{ctx, limitRange(file, n)})
+	if err != nil {
+		return "", fmt.Errorf("could not read file %s: %w", filepath, err)
+	}
+
+	return string(data), nil
+}
+
+// openForRead validates ReadFile arguments and opens the file
+func openForRead(args []string) (*os.File, string, error) {
 	if len(args) != 1 {
-		return "", fmt.Errorf("readFile requires exactly one argument (file path)")
+		return nil, "", fmt.Errorf("readFile requires exactly one argument (file path)")
 	}
 
 	filepath := args[0]
 	if filepath == "" {
-		return "", fmt.Errorf("file path cannot be empty")
+		return nil, "", fmt.Errorf("file path cannot be empty")
 	}
 
 	var err error
 	if runtime.GOOS == "linux" {
 		filepath, err = expandPath(filepath)
 		if err != nil {
-			return "", fmt.Errorf("could not expand file path %s: %w", filepath, err)
+			return nil, "", fmt.Errorf("could not expand file path %s: %w", filepath, err)
 		}
 	}
 
 	file, err := os.Open(filepath)
 	if err != nil {
-		return "", fmt.Errorf("could not open file %s: %w", filepath, err)
+		return nil, "", fmt.Errorf("could not open file %s: %w", filepath, err)
 	}
-	defer file.Close()
 
-	data, err := io.ReadAll(file)
+	return file, filepath, nil
+}
+
+// walkFilter selects the entries reported by WalkTree
+type walkFilter struct {
+	name    string // shell pattern matched against the entry name
+	kind    string // "f" for regular files, "d" for directories, empty for any
+	minSize int64
+	maxSize int64 // negative means no limit
+	newer   time.Time
+	older   time.Time
+	limit   int64 // stop after this many entries, 0 means no limit
+}
+
+// walkFlushSize is how much output a WalkTree worker collects before writing it out
+const walkFlushSize = 32 << 10
+
+// parseWalkArgs parses "WalkTree <root> [key=value ...]"
+// keys are name, type, min_size, max_size, newer, older (durations such as 24h, or dates) and limit
+func parseWalkArgs(args []string) (string, walkFilter, error) {
+	filter := walkFilter{maxSize: -1}
+	if len(args) < 1 {
+		return "", filter, fmt.Errorf("WalkTree requires a root directory and optional filters")
+	}
+
+	root, err := primitivePath(args[0])
 	if err != nil {
-		return "", fmt.Errorf("could not read file %s: %w", filepath, err)
+		return "", filter, err
 	}
 
-	return string(data), nil
+	for _, arg := range args[1:] {
+		key, value, found := strings.Cut(arg, "=")
+		if !found {
+			return "", filter, fmt.Errorf("invalid filter %s, expected key=value", arg)
+		}
+
+		switch key {
+		case "name":
+			if _, err := filepath.Match(value, ""); err != nil {
+				return "", filter, fmt.Errorf("invalid name pattern %s: %w", value, err)
+			}
+			filter.name = value
+		case "type":
+			if value != "f" && value != "d" {
+				return "", filter, fmt.Errorf("invalid type %s, expected f or d", value)
+			}
+			filter.kind = value
+		case "min_size", "max_size", "limit":
+			n, err := strconv.ParseInt(value, 10, 64)
+			if err != nil || n < 0 {
+				return "", filter, fmt.Errorf("invalid %s %s", key, value)
+			}
+			switch key {
+			case "min_size":
+				filter.minSize = n
+			case "max_size":
+				filter.maxSize = n
+			default:
+				filter.limit = n
+			}
+		case "newer", "older":
+			t, err := parseWalkTime(value)
+			if err != nil {
+				return "", filter, fmt.Errorf("invalid %s %s: %w", key, value, err)
+			}
+			if key == "newer" {
+				filter.newer = t
+			} else {
+				filter.older = t
+			}
+		default:
+			return "", filter, fmt.Errorf("unknown filter %s", key)
+		}
+	}
+
+	return root, filter, nil
+}
+
+// parseWalkTime accepts an age such as 90m or 24h, or a date
+func parseWalkTime(value string) (time.Time, error) {
+	if age, err := time.ParseDuration(value); err == nil {
+		return time.Now().Add(-age), nil
+	}
+	for _, layout := range []string{"2006-01-02", "2006-01-02 15:04:05", time.RFC3339} {
+		if t, err := time.ParseInLocation(layout, value, time.Local); err == nil {
+			return t, nil
+		}
+	}
+	return time.Time{}, fmt.Errorf("expected a duration or a date")
+}
+
+// match reports whether an entry passes the filter, info is only loaded when needed
+func (f *walkFilter) match(entry fs.DirEntry) (fs.FileInfo, bool) {
+	if f.kind == "f" && !entry.Type().IsRegular() || f.kind == "d" && !entry.IsDir() {
+		return nil, false
+	}
+	if f.name != "" {
+		if ok, _ := filepath.Match(f.name, entry.Name()); !ok {
+			return nil, false
+		}
+	}
+
+	info, err := entry.Info()
+	if err != nil {
+		return nil, false // removed while walking
+	}
+	if info.Size() < f.minSize || f.maxSize >= 0 && info.Size() > f.maxSize {
+		return nil, false
+	}
+	if !f.newer.IsZero() && !info.ModTime().After(f.newer) || !f.older.IsZero() && !info.ModTime().Before(f.older) {
+		return nil, false
+	}
+	return info, true
+}
+
+// walkTree primitive - entries below a directory matching the filters, walked in parallel
+// one "<type> <size> <modified> <path>" line per entry, in no particular order
+func walkTree(ctx context.Context, args []string) (string, error) {
+	var out bytes.Buffer
+	if err := streamWalkTree(ctx, args, &out); err != nil {
+		return "", err
+	}
+
+	if out.Len() == 0 {
+		return "No entries match", nil
+	}
+	return out.String(), nil
+}
+
+// streamWalkTree is WalkTree writing its output to w while the walk runs
+// every worker collects lines on its own and writes them out in blocks of walkFlushSize
+func streamWalkTree(ctx context.Context, args []string, w io.Writer) error {
+	root, filter, err := parseWalkArgs(args)
+	if err != nil {
+		return err
+	}
+
+	info, err := os.Stat(root)
+	if err != nil {
+		return fmt.Errorf("could not stat %s: %w", root, err)
+	}
+	if !info.IsDir() {
+		return fmt.Errorf("%s is not a directory", root)
+	}
+
+	var (
+		mu      sync.Mutex // serializes writes to w
+		matched atomic.Int64
+		buffers = make([]bytes.Buffer, DefaultWorkers)
+	)
+	flush := func(buf *bytes.Buffer) error {
+		mu.Lock()
+		defer mu.Unlock()
+		_, err := w.Write(buf.Bytes())
+		buf.Reset()
+		return err
+	}
+
+	err = walkParallel(ctx, root, DefaultWorkers, func(worker int, dir string, entry fs.DirEntry) error {
+		info, ok := filter.match(entry)
+		if !ok {
+			return nil
+		}
+
+		n := matched.Add(1)
+		if filter.limit > 0 && n > filter.limit {
+			return errStopWalk
+		}
+
+		buf := &buffers[worker]
+		fmt.Fprintf(buf, "%s %d %s %s\n", entryType(info.Mode()), info.Size(),
+			info.ModTime().Format("2006-01-02 15:04"), filepath.Join(dir, entry.Name()))
+		if buf.Len() >= walkFlushSize {
+			return flush(buf)
+		}
+		return nil
+	})
+	if err != nil {
+		return fmt.Errorf("could not walk %s: %w", root, err)
+	}
+
+	for i := range buffers {
+		if buffers[i].Len() > 0 {
+			if err := flush(&buffers[i]); err != nil {
+				return fmt.Errorf("could not write walk results: %w", err)
+			}
+		}
+	}
+	return nil
 }
 
 // registerPrimitive adds a new primitive to the registry
@@ -239,11 +514,14 @@ func RegisterPrimitive(name string, fn primitiveFunc) {
 	primitiveRegistry[name] = fn
 }
 
-// run executes a single command
-func (c *Command) Run() Response {
+// run executes a single command, ctx cancels it and bounds it together with the command's own timeout
+func (c *Command) Run(ctx context.Context) Response {
 	if c.Name == "" {
 		return Response{"", "command name cannot be empty", StatusError}
 	}
+	if err := ctx.Err(); err != nil {
+		return Response{"", fmt.Sprintf("command %s not run: %v", c.Name, err), StatusError}
+	}
 
 	// look up primitive function in registry
 	fn, exists := primitiveRegistry[c.Name]
@@ -251,23 +529,58 @@ func (c *Command) Run() Response {
 		return Response{"", fmt.Sprintf("primitive %s is not implemented", c.Name), StatusError}
 	}
 
-	// execute the primitive function
-	data, err := fn(c.Args)
+	ctx, cancel := c.context(ctx)
+	defer cancel()
+
+	// execute the primitive function, read-only ones through the read cache if enabled
+	var data string
+	var err error
+	if stat, cacheable := cachedPrimitives[c.Name]; cacheable && readCache != nil {
+		data, err = readCache.call(ctx, c, stat, fn)
+	} else {
+		data, err = fn(ctx, c.Args)
+	}
 	if err != nil {
-		return Response{"", fmt.Sprintf("error running primitive %s: %v", c.Name, err), StatusError}
+		return c.failed(ctx, err)
 	}
 
 	return Response{data, "", StatusOK}
 }
 
-// runBatch executes multiple commands in sequence
-func (b *Batch) RunBatch() BatchResponse {
+// context applies the command's timeout to ctx
+func (c *Command) context(ctx context.Context) (context.Context, context.CancelFunc) {
+	if c.TimeoutMs > 0 {
+		return context.WithTimeout(ctx, time.Duration(c.TimeoutMs)*time.Millisecond)
+	}
+	return context.WithCancel(ctx)
+}
+
+// failed builds the response of a primitive that returned err, naming the cause if ctx ended it
+func (c *Command) failed(ctx context.Context, err error) Response {
+	switch ctx.Err() {
+	case context.DeadlineExceeded:
+		err = fmt.Errorf("timed out: %w", err)
+	case context.Canceled:
+		err = fmt.Errorf("canceled: %w", err)
+	}
+	return Response{"", fmt.Sprintf("error running primitive %s: %v", c.Name, err), StatusError}
+}
+
+// runBatch executes multiple commands in sequence, commands not started when ctx ends fail
+func (b *Batch) RunBatch(ctx context.Context) BatchResponse {
+	return b.run(b.coalesceAppends(func(i int) Response {
+		return b.Commands[i].Run(ctx)
+	}))
+}
+
+// run calls run(i) for every command in order and collects the results
+func (b *Batch) run(run func(i int) Response) BatchResponse {
 	results := make([]Response, len(b.Commands))
 	overallStatus := StatusOK
 
 	// execute each command in the batch
-	for i, cmd := range b.Commands {
-		results[i] = cmd.Run()
+	for i := range b.Commands {
+		results[i] = run(i)
 
 		// if any command fails, mark overall status as error
 		if results[i].Status != StatusOK {
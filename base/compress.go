@@ -0,0 +1,68 @@
+package base
+
+import (
+	"bytes"
+	"compress/gzip"
+	"io"
+	"sync"
+)
+
+// frames with payloads larger than CompressThreshold are gzip compressed on connections
+// that negotiated CapGzip; FlagCompressed tells the reader to inflate them
+// for chunk frames only the output bytes are compressed, the command index stays readable
+
+// CompressThreshold is the payload size from which compression is worth its cpu time
+const CompressThreshold = 4 << 10
+
+// gzipWriters recycles compressors, their internal state is large
+var gzipWriters = sync.Pool{
+	New: func() any {
+		w, _ := gzip.NewWriterLevel(nil, gzip.BestSpeed)
+		return w
+	},
+}
+
+// compressible reports whether frames of this type may carry compressed payloads
+func compressible(frameType byte) bool {
+	return frameType == FrameBatchResponse || frameType == FrameChunk
+}
+
+// compress gzips data, ok is false when compression did not make it smaller
+func compress(data []byte) ([]byte, bool) {
+	var buf bytes.Buffer
+	buf.Grow(len(data) / 4)
+
+	w := gzipWriters.Get().(*gzip.Writer)
+	w.Reset(&buf)
+	_, err := w.Write(data)
+	if cerr := w.Close(); err == nil {
+		err = cerr
+	}
+	gzipWriters.Put(w)
+
+	if err != nil || buf.Len() >= len(data) {
+		return nil, false
+	}
+	return buf.Bytes(), true
+}
+
+// NewPayloadReader returns a reader over a frame payload, inflating it on the fly if compressed
+func NewPayloadReader(f Frame, payload []byte) (io.Reader, error) {
+	if f.Flags&FlagCompressed == 0 {
+		return bytes.NewReader(payload), nil
+	}
+	return gzip.NewReader(bytes.NewReader(payload))
+}
+
+// inflate returns the uncompressed payload of f
+func inflate(f Frame, payload []byte) ([]byte, error) {
+	if f.Flags&FlagCompressed == 0 {
+		return payload, nil
+	}
+
+	r, err := NewPayloadReader(f, payload)
+	if err != nil {
+		return nil, err
+	}
+	return io.ReadAll(r)
+}
@@ -6,7 +6,10 @@ import (
 	"encoding/json"
 	"fmt"
 	"io"
+	"net"
 	"net/http"
+	"sync"
+	"sync/atomic"
 	"time"
 )
 
@@ -47,6 +50,44 @@ type Config struct {
 	OllamaURL    string
 	OpenAIAPIKey string
 	Timeout      time.Duration
+
+	// how long Ollama keeps a model loaded after a request, 0 leaves it to the server (5m) and
+	// a negative value keeps it loaded for good
+	KeepAlive time.Duration
+
+	// model options sent with every request, a call can override single fields
+	Options GenerateOptions
+
+	// let GetResponseWithPrefix send prompt prefixes as the system message of a chat, which
+	// Ollama keeps evaluated between prompts, see llmprefix.go
+	ReusePrefixes bool
+}
+
+// GenerateOptions are the model options a request can carry, zero fields are left to the server
+// OpenAI models only honor NumPredict (as max_tokens) and Temperature
+type GenerateOptions struct {
+	NumCtx      int      `json:"num_ctx,omitempty"`     // context window in tokens
+	NumPredict  int      `json:"num_predict,omitempty"` // most tokens generated
+	Temperature *float64 `json:"temperature,omitempty"` // nil for the model's default, 0 is greedy
+}
+
+// over returns o with the fields set in override replaced
+func (o GenerateOptions) over(override GenerateOptions) GenerateOptions {
+	if override.NumCtx != 0 {
+		o.NumCtx = override.NumCtx
+	}
+	if override.NumPredict != 0 {
+		o.NumPredict = override.NumPredict
+	}
+	if override.Temperature != nil {
+		o.Temperature = override.Temperature
+	}
+	return o
+}
+
+// isZero reports whether no option is set
+func (o GenerateOptions) isZero() bool {
+	return o.NumCtx == 0 && o.NumPredict == 0 && o.Temperature == nil
 }
 
 // returns default configuration for an LLM client
@@ -64,6 +105,7 @@ func (c *LLMClient) SetOpenAIKey(apiKey string) {
 
 func (c *LLMClient) SetTimeout(timeout time.Duration) {
 	c.config.Timeout = timeout
+	c.httpClient.Timeout = timeout
 }
 
 func (c *LLMClient) SetModel(model Model) error {
@@ -92,26 +134,62 @@ func CreateConfig(defaultModel Model, ollamaURL, openAIAPIKey string, timeout ti
 type LLMClient struct {
 	config     *Config
 	httpClient *http.Client
+	noChat     atomic.Bool // the server has no chat API, prefixes go in front of the prompt
+}
+
+// NewTransport returns an http transport tuned for many requests to the same model servers
+// idle connections are kept alive and pooled per host, http2 is negotiated over TLS when enabled
+func NewTransport(http2 bool) *http.Transport {
+	return &http.Transport{
+		Proxy: http.ProxyFromEnvironment,
+		DialContext: (&net.Dialer{
+			Timeout:   30 * time.Second,
+			KeepAlive: 30 * time.Second,
+		}).DialContext,
+		ForceAttemptHTTP2:     http2,
+		MaxIdleConns:          64,
+		MaxIdleConnsPerHost:   16,
+		IdleConnTimeout:       5 * time.Minute,
+		TLSHandshakeTimeout:   10 * time.Second,
+		ExpectContinueTimeout: time.Second,
+	}
 }
 
+// sharedTransport is used by every client that isn't given its own http client,
+// so all LLM clients of a process share one connection pool
+var sharedTransport = NewTransport(true)
+
 // get a new LLM client, possibly with default configuration
+// the client uses the process-wide connection pool
 func NewLLMClient(config *Config) *LLMClient {
 	if config == nil {
 		config = DefaultConfig()
 	}
 
+	return NewLLMClientWithHTTPClient(config, &http.Client{
+		Timeout:   config.Timeout,
+		Transport: sharedTransport,
+	})
+}
+
+// NewLLMClientWithHTTPClient creates an LLM client that sends its requests through httpClient
+func NewLLMClientWithHTTPClient(config *Config, httpClient *http.Client) *LLMClient {
+	if config == nil {
+		config = DefaultConfig()
+	}
+
 	return &LLMClient{
-		config: config,
-		httpClient: &http.Client{
-			Timeout: config.Timeout,
-		},
+		config:     config,
+		httpClient: httpClient,
 	}
 }
 
 type ollamaRequest struct {
-	ModelName string `json:"model"`
-	Prompt    string `json:"prompt"`
-	Stream    bool   `json:"stream"`
+	ModelName string           `json:"model"`
+	Prompt    string           `json:"prompt"`
+	Stream    bool             `json:"stream"`
+	KeepAlive string           `json:"keep_alive,omitempty"`
+	Options   *GenerateOptions `json:"options,omitempty"`
 }
 
 type ollamaResponse struct {
@@ -125,6 +203,9 @@ type openAIRequest struct {
 	Model    string          `json:"model"`
 	Messages []openAIMessage `json:"messages"`
 	Stream   bool            `json:"stream"`
+
+	MaxTokens   int      `json:"max_tokens,omitempty"`
+	Temperature *float64 `json:"temperature,omitempty"`
 }
 
 // represents a message in the OpenAI API
@@ -151,73 +232,229 @@ type openAIError struct {
 }
 
 // GetReponseWithModel generates a response using the specified model
+// identical requests in flight at the same time share one model call, see coalesce
 func (c *LLMClient) GetReponseWithModel(ctx context.Context, message string, model Model) (string, error) {
+	return c.GetResponseWithOptions(ctx, message, model, GenerateOptions{})
+}
+
+// GetResponseWithOptions is GetReponseWithModel with options overriding the configured ones for this call
+func (c *LLMClient) GetResponseWithOptions(ctx context.Context, message string, model Model, opts GenerateOptions) (string, error) {
 	if !model.IsValid() {
 		return "", fmt.Errorf("invalid model: %s", model.String())
 	}
 
+	opts = c.config.Options.over(opts)
+	return sharedCalls.do(ctx, c.callKey(message, model, opts), func(ctx context.Context) (string, error) {
+		return c.getResponse(ctx, message, model, opts)
+	})
+}
+
+// getResponse sends the request to the backend serving model
+func (c *LLMClient) getResponse(ctx context.Context, message string, model Model, opts GenerateOptions) (string, error) {
 	switch model {
 	case Llama2, Llama3, Codellama:
-		return c.getResponseFromOllama(ctx, message, model)
+		return c.getResponseFromOllama(ctx, message, model, opts)
 	case GPT4o, GPT35Turbo:
-		return c.getResponseFromOpenAI(ctx, message, model)
+		return c.getResponseFromOpenAI(ctx, message, model, opts)
 	default:
 		return "", fmt.Errorf("unsupported model: %s", model.String())
 	}
 }
 
+// inflightCall is a model call shared by every caller asking the same thing at the same time
+type inflightCall struct {
+	done     chan struct{}
+	response string
+	err      error
+
+	waiters int                // callers still waiting, guarded by coalescer.mu
+	cancel  context.CancelFunc // stops the call once every waiter gave up
+}
+
+// coalescer runs at most one model call per key at a time
+type coalescer struct {
+	mu     sync.Mutex
+	calls  map[string]*inflightCall
+	shared atomic.Uint64 // callers that got the result of a call started by someone else
+}
+
+// sharedCalls coalesces the calls of all clients of the process
+var sharedCalls = coalescer{calls: make(map[string]*inflightCall)}
+
+// callKey identifies a request, the same prompt to the same model on the same server with the same options
+func (c *LLMClient) callKey(message string, model Model, opts GenerateOptions) string {
+	server := c.config.OllamaURL
+	if model == GPT4o || model == GPT35Turbo {
+		server = c.config.OpenAIAPIKey
+	}
+	options, _ := json.Marshal(opts)
+	return model.String() + "\x00" + server + "\x00" + string(options) + "\x00" + message
+}
+
+// do returns the result of fn for key, joining a call already in flight for the same key
+// the call runs detached from the caller that started it and is cancelled only when
+// every caller waiting for it has given up
+func (co *coalescer) do(ctx context.Context, key string, fn func(ctx context.Context) (string, error)) (string, error) {
+	co.mu.Lock()
+	call, joined := co.calls[key]
+	if joined {
+		call.waiters++
+		co.shared.Add(1)
+	} else {
+		callCtx, cancel := context.WithCancel(context.WithoutCancel(ctx))
+		call = &inflightCall{done: make(chan struct{}), waiters: 1, cancel: cancel}
+		co.calls[key] = call
+
+		go func() {
+			call.response, call.err = fn(callCtx)
+			co.mu.Lock()
+			co.forget(key, call)
+			co.mu.Unlock()
+			cancel()
+			close(call.done)
+		}()
+	}
+	co.mu.Unlock()
+
+	select {
+	case <-call.done:
+		return call.response, call.err
+	case <-ctx.Done():
+		co.mu.Lock()
+		if call.waiters--; call.waiters == 0 {
+			// abandoned, later callers must not join a call that is being cancelled
+			call.cancel()
+			co.forget(key, call)
+		}
+		co.mu.Unlock()
+		return "", ctx.Err()
+	}
+}
+
+// forget removes call from the in-flight calls unless a newer call took its key, the caller holds mu
+func (co *coalescer) forget(key string, call *inflightCall) {
+	if co.calls[key] == call {
+		delete(co.calls, key)
+	}
+}
+
+// CoalescedCalls returns how many model calls were answered by sharing another caller's call
+func CoalescedCalls() uint64 {
+	return sharedCalls.shared.Load()
+}
+
 // this generates a response using the default model
 func (c *LLMClient) GetResponse(ctx context.Context, message string) (string, error) {
 	return c.GetReponseWithModel(ctx, message, c.config.DefaultModel)
 }
 
-// this handles requests to the Ollama API
-func (c *LLMClient) getResponseFromOllama(ctx context.Context, message string, model Model) (string, error) {
+// newOllamaRequest builds a request for model with the client's keep-alive and opts
+func (c *LLMClient) newOllamaRequest(message string, model Model, opts GenerateOptions, stream bool) ollamaRequest {
 	req := ollamaRequest{
 		ModelName: model.String(),
 		Prompt:    message,
-		Stream:    false,
+		Stream:    stream,
 	}
+	if c.config.KeepAlive != 0 {
+		// ollama reads durations as strings, negative ones keep the model loaded for good
+		req.KeepAlive = c.config.KeepAlive.String()
+	}
+	if !opts.isZero() {
+		req.Options = &opts
+	}
+	return req
+}
 
+// Preload makes Ollama load model and keep it loaded for the configured keep-alive without
+// generating anything, so the first real request doesn't pay for loading it
+// OpenAI models need no preloading
+func (c *LLMClient) Preload(ctx context.Context, model Model) error {
+	switch model {
+	case Llama2, Llama3, Codellama:
+		// a request without a prompt only loads the model; it carries the configured options,
+		// a runner loaded with another num_ctx would be reloaded by the first real request
+		_, err := c.postOllama(ctx, c.newOllamaRequest("", model, c.config.Options, false))
+		if err != nil {
+			return fmt.Errorf("could not preload %s: %w", model.String(), err)
+		}
+		return nil
+	case GPT4o, GPT35Turbo:
+		return nil
+	default:
+		return fmt.Errorf("unsupported model: %s", model.String())
+	}
+}
+
+// this handles requests to the Ollama API
+func (c *LLMClient) getResponseFromOllama(ctx context.Context, message string, model Model, opts GenerateOptions) (string, error) {
+	resp, err := c.postOllama(ctx, c.newOllamaRequest(message, model, opts, false))
+	if err != nil {
+		return "", err
+	}
+	return resp.Response, nil
+}
+
+// openOllama posts req to the Ollama endpoint at url and returns the response of a
+// successful request, the caller closes its body
+func (c *LLMClient) openOllama(ctx context.Context, url string, req any) (*http.Response, error) {
 	data, err := json.Marshal(req)
 	if err != nil {
-		return "", fmt.Errorf("failed to marshal request: %w", err)
+		return nil, fmt.Errorf("failed to marshal request: %w", err)
 	}
 
-	httpReq, err := http.NewRequestWithContext(ctx, "POST", c.config.OllamaURL, bytes.NewReader(data))
+	httpReq, err := http.NewRequestWithContext(ctx, "POST", url, bytes.NewReader(data))
 	if err != nil {
-		return "", fmt.Errorf("failed to create HTTP request: %w", err)
+		return nil, fmt.Errorf("failed to create HTTP request: %w", err)
 	}
 	httpReq.Header.Set("Content-Type", "application/json")
 
 	httpResp, err := c.httpClient.Do(httpReq)
 	if err != nil {
-		return "", fmt.Errorf("HTTP request failed: %w", err)
+		return nil, fmt.Errorf("HTTP request failed: %w", err)
 	}
-	defer httpResp.Body.Close()
 
 	if httpResp.StatusCode != http.StatusOK {
-		return "", fmt.Errorf("ollama API returned status %d", httpResp.StatusCode)
+		httpResp.Body.Close()
+		return nil, &ollamaStatusError{httpResp.StatusCode}
+	}
+	return httpResp, nil
+}
+
+// ollamaStatusError is a request the Ollama API answered with a status other than 200
+type ollamaStatusError struct {
+	status int
+}
+
+func (e *ollamaStatusError) Error() string {
+	return fmt.Sprintf("ollama API returned status %d", e.status)
+}
+
+// postOllama sends a request that is answered with a single response
+func (c *LLMClient) postOllama(ctx context.Context, req ollamaRequest) (ollamaResponse, error) {
+	httpResp, err := c.openOllama(ctx, c.config.OllamaURL, req)
+	if err != nil {
+		return ollamaResponse{}, err
 	}
+	defer httpResp.Body.Close()
 
 	body, err := io.ReadAll(httpResp.Body)
 	if err != nil {
-		return "", fmt.Errorf("failed to read ollama response: %w", err)
+		return ollamaResponse{}, fmt.Errorf("failed to read ollama response: %w", err)
 	}
 
 	var resp ollamaResponse
 	if err := json.Unmarshal(body, &resp); err != nil {
-		return "", fmt.Errorf("failed to unmarshal ollama response: %w", err)
+		return ollamaResponse{}, fmt.Errorf("failed to unmarshal ollama response: %w", err)
 	}
 
 	if resp.Error != "" {
-		return "", fmt.Errorf("ollama API error: %s", resp.Error)
+		return ollamaResponse{}, fmt.Errorf("ollama API error: %s", resp.Error)
 	}
 
-	return resp.Response, nil
+	return resp, nil
 }
 
-func (c *LLMClient) getResponseFromOpenAI(ctx context.Context, message string, model Model) (string, error) {
+func (c *LLMClient) getResponseFromOpenAI(ctx context.Context, message string, model Model, opts GenerateOptions) (string, error) {
 	if c.config.OpenAIAPIKey == "" {
 		return "", fmt.Errorf("OpenAI API key is not set")
 	}
@@ -230,7 +467,9 @@ func (c *LLMClient) getResponseFromOpenAI(ctx context.Context, message string, m
 				Content: message,
 			},
 		},
-		Stream: false,
+		Stream:      false,
+		MaxTokens:   opts.NumPredict,
+		Temperature: opts.Temperature,
 	}
 
 	data, err := json.Marshal(req)
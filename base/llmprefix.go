@@ -0,0 +1,157 @@
+package base
+
+import (
+	"bufio"
+	"context"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"net/http"
+	"strings"
+)
+
+// prompt prefix reuse: callers that put the same long preamble in front of every prompt hand it
+// over separately, it goes to Ollama's chat API as the system message and the request as the
+// user message; every prompt then starts with the same tokens, and the runner keeps those
+// evaluated from one prompt to the next instead of reading the preamble again
+//
+// servers without the chat API, and chat requests that fail before any token arrived, fall
+// back to sending the whole prompt
+
+// ollamaMessage is one message of a chat
+type ollamaMessage struct {
+	Role    string `json:"role"`
+	Content string `json:"content"`
+}
+
+type ollamaChatRequest struct {
+	ModelName string           `json:"model"`
+	Messages  []ollamaMessage  `json:"messages"`
+	Stream    bool             `json:"stream"`
+	KeepAlive string           `json:"keep_alive,omitempty"`
+	Options   *GenerateOptions `json:"options,omitempty"`
+}
+
+type ollamaChatResponse struct {
+	Message ollamaMessage `json:"message"`
+	Done    bool          `json:"done"`
+	Error   string        `json:"error,omitempty"`
+}
+
+// GetResponseWithPrefix generates a response to prefix+message like GetResponseWithOptions
+// with ReusePrefixes set, Ollama gets prefix as the system message and keeps it evaluated
+func (c *LLMClient) GetResponseWithPrefix(ctx context.Context, prefix, message string, model Model, opts GenerateOptions) (string, error) {
+	if !c.config.ReusePrefixes || !isOllama(model) {
+		return c.GetResponseWithOptions(ctx, prefix+message, model, opts)
+	}
+
+	opts = c.config.Options.over(opts)
+	return sharedCalls.do(ctx, c.callKey(prefix+message, model, opts), func(ctx context.Context) (string, error) {
+		return c.generateWithPrefix(ctx, prefix, message, model, opts, nil)
+	})
+}
+
+// StreamResponseWithPrefix is StreamResponseWithOptions for prefix+message, reusing the
+// evaluated prefix like GetResponseWithPrefix
+func (c *LLMClient) StreamResponseWithPrefix(ctx context.Context, prefix, message string, model Model, opts GenerateOptions, onToken func(token string) error) (string, error) {
+	if !c.config.ReusePrefixes || !isOllama(model) {
+		return c.StreamResponseWithOptions(ctx, prefix+message, model, opts, onToken)
+	}
+
+	return c.generateWithPrefix(ctx, prefix, message, model, c.config.Options.over(opts), onToken)
+}
+
+// isOllama reports whether model is served by Ollama
+func isOllama(model Model) bool {
+	return model == Llama2 || model == Llama3 || model == Codellama
+}
+
+// chatURL returns the chat endpoint next to the configured generate endpoint, "" if there is none
+func (c *LLMClient) chatURL() string {
+	base, ok := strings.CutSuffix(c.config.OllamaURL, "/api/generate")
+	if !ok || c.noChat.Load() {
+		return ""
+	}
+	return base + "/api/chat"
+}
+
+// generateWithPrefix sends prefix as the system message and message as the user message of a
+// chat, streaming to onToken unless it is nil
+// without a chat endpoint, or when the chat fails before any token arrived, the prompt is sent whole
+func (c *LLMClient) generateWithPrefix(ctx context.Context, prefix, message string, model Model, opts GenerateOptions, onToken func(token string) error) (string, error) {
+	if url := c.chatURL(); url != "" {
+		req := ollamaChatRequest{
+			ModelName: model.String(),
+			Messages:  []ollamaMessage{{Role: "system", Content: strings.TrimSpace(prefix)}, {Role: "user", Content: message}},
+			Stream:    onToken != nil,
+		}
+		if c.config.KeepAlive != 0 {
+			req.KeepAlive = c.config.KeepAlive.String()
+		}
+		if !opts.isZero() {
+			req.Options = &opts
+		}
+
+		delivered := false
+		response, err := c.chatOllama(ctx, url, req, func(token string) error {
+			delivered = true
+			return onToken(token)
+		})
+		if err == nil || delivered || ctx.Err() != nil {
+			return response, err
+		}
+		var status *ollamaStatusError
+		if errors.As(err, &status) && status.status == http.StatusNotFound {
+			c.noChat.Store(true)
+		}
+	}
+
+	req := c.newOllamaRequest(prefix+message, model, opts, onToken != nil)
+	if req.Stream {
+		return c.streamResponseFromOllama(ctx, req, onToken)
+	}
+	resp, err := c.postOllama(ctx, req)
+	if err != nil {
+		return "", err
+	}
+	return resp.Response, nil
+}
+
+// chatOllama sends a chat request and reads its answer, streamed to onToken when req.Stream is set
+// a stream stopped with ErrStopStream closes the connection unread, which aborts the generation
+func (c *LLMClient) chatOllama(ctx context.Context, url string, req ollamaChatRequest, onToken func(token string) error) (string, error) {
+	httpResp, err := c.openOllama(ctx, url, req)
+	if err != nil {
+		return "", err
+	}
+	defer httpResp.Body.Close()
+
+	var text strings.Builder
+	decoder := json.NewDecoder(bufio.NewReader(httpResp.Body))
+	for {
+		var resp ollamaChatResponse
+		if err := decoder.Decode(&resp); err != nil {
+			return "", fmt.Errorf("failed to read ollama chat response: %w", err)
+		}
+
+		if resp.Error != "" {
+			return "", fmt.Errorf("ollama API error: %s", resp.Error)
+		}
+
+		if token := resp.Message.Content; token != "" {
+			text.WriteString(token)
+			if req.Stream {
+				if err := onToken(token); err != nil {
+					if errors.Is(err, ErrStopStream) {
+						return text.String(), nil
+					}
+					return "", err
+				}
+			}
+		}
+
+		if resp.Done {
+			return text.String(), nil
+		}
+	}
+}
@@ -0,0 +1,112 @@
+package base
+
+import (
+	"bufio"
+	"context"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"strings"
+)
+
+// ErrStopStream returned by a token handler ends the generation early without an error,
+// the response is the text up to and including the token that stopped it
+var ErrStopStream = errors.New("stop stream")
+
+// StreamResponseWithModel generates a response with model, handing every token to onToken as it arrives
+// it returns the full text; OpenAI models are not streamed and deliver their answer as a single token
+func (c *LLMClient) StreamResponseWithModel(ctx context.Context, message string, model Model, onToken func(token string) error) (string, error) {
+	return c.StreamResponseWithOptions(ctx, message, model, GenerateOptions{}, onToken)
+}
+
+// StreamResponseWithOptions is StreamResponseWithModel with options overriding the configured ones for this call
+func (c *LLMClient) StreamResponseWithOptions(ctx context.Context, message string, model Model, opts GenerateOptions, onToken func(token string) error) (string, error) {
+	if !model.IsValid() {
+		return "", fmt.Errorf("invalid model: %s", model.String())
+	}
+
+	return c.streamResponse(ctx, message, model, c.config.Options.over(opts), onToken)
+}
+
+// GetResponseUntil generates a response to prefix+message like GetResponseWithPrefix, but the
+// response is streamed and generation ends as soon as until reports the text complete, so a
+// model that keeps talking after its answer doesn't hold up the caller
+// until is called with every token and must only depend on the text; identical calls in flight
+// at the same time share one generation, stopped by the until of the caller that started it
+func (c *LLMClient) GetResponseUntil(ctx context.Context, prefix, message string, model Model, opts GenerateOptions, until func(token string) bool) (string, error) {
+	if !model.IsValid() {
+		return "", fmt.Errorf("invalid model: %s", model.String())
+	}
+
+	opts = c.config.Options.over(opts)
+	key := c.callKey(prefix+message, model, opts) + "\x00until"
+	return sharedCalls.do(ctx, key, func(ctx context.Context) (string, error) {
+		onToken := func(token string) error {
+			if until(token) {
+				return ErrStopStream
+			}
+			return nil
+		}
+
+		if c.config.ReusePrefixes && isOllama(model) {
+			return c.generateWithPrefix(ctx, prefix, message, model, opts, onToken)
+		}
+		return c.streamResponse(ctx, prefix+message, model, opts, onToken)
+	})
+}
+
+// streamResponse streams message from the backend serving model, opts are final
+func (c *LLMClient) streamResponse(ctx context.Context, message string, model Model, opts GenerateOptions, onToken func(token string) error) (string, error) {
+	switch model {
+	case Llama2, Llama3, Codellama:
+		return c.streamResponseFromOllama(ctx, c.newOllamaRequest(message, model, opts, true), onToken)
+	case GPT4o, GPT35Turbo:
+		response, err := c.getResponseFromOpenAI(ctx, message, model, opts)
+		if err != nil {
+			return "", err
+		}
+		if err := onToken(response); err != nil && !errors.Is(err, ErrStopStream) {
+			return "", err
+		}
+		return response, nil
+	default:
+		return "", fmt.Errorf("unsupported model: %s", model.String())
+	}
+}
+
+// this consumes the NDJSON token stream of the Ollama API
+// a stopped stream closes the connection unread, which makes Ollama abort the generation
+func (c *LLMClient) streamResponseFromOllama(ctx context.Context, req ollamaRequest, onToken func(token string) error) (string, error) {
+	httpResp, err := c.openOllama(ctx, c.config.OllamaURL, req)
+	if err != nil {
+		return "", err
+	}
+	defer httpResp.Body.Close()
+
+	var text strings.Builder
+	decoder := json.NewDecoder(bufio.NewReader(httpResp.Body))
+	for {
+		var resp ollamaResponse
+		if err := decoder.Decode(&resp); err != nil {
+			return "", fmt.Errorf("failed to read ollama stream: %w", err)
+		}
+
+		if resp.Error != "" {
+			return "", fmt.Errorf("ollama API error: %s", resp.Error)
+		}
+
+		if resp.Response != "" {
+			text.WriteString(resp.Response)
+			if err := onToken(resp.Response); err != nil {
+				if errors.Is(err, ErrStopStream) {
+					return text.String(), nil
+				}
+				return "", err
+			}
+		}
+
+		if resp.Done {
+			return text.String(), nil
+		}
+	}
+}
@@ -0,0 +1,347 @@
+package base
+
+import (
+	"bufio"
+	"bytes"
+	"context"
+	"fmt"
+	"io"
+	"io/fs"
+	"os"
+	"path/filepath"
+	"regexp"
+	"runtime"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+)
+
+// native primitives answer the questions models usually ask through CommandExec
+// (ls, stat, grep, head, tail, du, globbing) without forking a shell
+
+// defaultLines is how many lines Head and Tail return when no count is given
+const defaultLines = 10
+
+// primitivePath validates and expands a path argument
+func primitivePath(path string) (string, error) {
+	if path == "" {
+		return "", fmt.Errorf("file path cannot be empty")
+	}
+
+	if runtime.GOOS == "linux" {
+		expanded, err := expandPath(path)
+		if err != nil {
+			return "", fmt.Errorf("could not expand file path %s: %w", path, err)
+		}
+		path = expanded
+	}
+	return path, nil
+}
+
+// lineCount parses the optional line count argument of Head and Tail
+func lineCount(name string, args []string) (int, error) {
+	if len(args) < 1 || len(args) > 2 {
+		return 0, fmt.Errorf("%s requires a file path and an optional line count", name)
+	}
+	if len(args) == 1 {
+		return defaultLines, nil
+	}
+
+	n, err := strconv.Atoi(args[1])
+	if err != nil || n < 0 {
+		return 0, fmt.Errorf("invalid line count %s", args[1])
+	}
+	return n, nil
+}
+
+// entryType is the one letter type column of ListDir, as in ls -l
+func entryType(mode fs.FileMode) string {
+	switch {
+	case mode.IsDir():
+		return "d"
+	case mode&fs.ModeSymlink != 0:
+		return "l"
+	case mode.IsRegular():
+		return "-"
+	default:
+		return "?"
+	}
+}
+
+// listDir primitive - one "<type> <size> <name>" line per directory entry, sorted by name
+func listDir(ctx context.Context, args []string) (string, error) {
+	if len(args) != 1 {
+		return "", fmt.Errorf("ListDir requires exactly one argument (directory path)")
+	}
+
+	dir, err := primitivePath(args[0])
+	if err != nil {
+		return "", err
+	}
+
+	entries, err := os.ReadDir(dir)
+	if err != nil {
+		return "", fmt.Errorf("could not list directory %s: %w", dir, err)
+	}
+	if len(entries) == 0 {
+		return fmt.Sprintf("Directory %s is empty", dir), nil
+	}
+
+	var out strings.Builder
+	for _, entry := range entries {
+		info, err := entry.Info()
+		if err != nil {
+			continue // removed while listing
+		}
+		name := entry.Name()
+		if entry.IsDir() {
+			name += "/"
+		}
+		fmt.Fprintf(&out, "%s %d %s\n", entryType(info.Mode()), info.Size(), name)
+	}
+	return out.String(), nil
+}
+
+// statPath primitive - type, size, permissions and modification time of a path
+func statPath(ctx context.Context, args []string) (string, error) {
+	if len(args) != 1 {
+		return "", fmt.Errorf("Stat requires exactly one argument (path)")
+	}
+
+	path, err := primitivePath(args[0])
+	if err != nil {
+		return "", err
+	}
+
+	info, err := os.Lstat(path)
+	if err != nil {
+		return "", fmt.Errorf("could not stat %s: %w", path, err)
+	}
+
+	kind := "file"
+	switch {
+	case info.IsDir():
+		kind = "directory"
+	case info.Mode()&fs.ModeSymlink != 0:
+		kind = "symlink"
+	case !info.Mode().IsRegular():
+		kind = "special"
+	}
+
+	return fmt.Sprintf("path: %s\ntype: %s\nsize: %d\nmode: %s\nmodified: %s\n",
+		path, kind, info.Size(), info.Mode(), info.ModTime().Format("2006-01-02 15:04:05 -0700")), nil
+}
+
+// headFile primitive - first n lines of a file, reading no further than needed
+func headFile(ctx context.Context, args []string) (string, error) {
+	n, err := lineCount("Head", args)
+	if err != nil {
+		return "", err
+	}
+
+	file, filepath, err := openForRead(args[:1])
+	if err != nil {
+		return "", err
+	}
+	defer file.Close()
+
+	var out bytes.Buffer
+	r := bufio.NewReader(file)
+	for lines := 0; lines < n; lines++ {
+		line, err := r.ReadSlice('\n')
+		out.Write(line)
+		if err == bufio.ErrBufferFull {
+			lines-- // long line, keep reading it
+			continue
+		}
+		if err == io.EOF {
+			break
+		}
+		if err != nil {
+			return "", fmt.Errorf("could not read file %s: %w", filepath, err)
+		}
+	}
+	return out.String(), nil
+}
+
+// tailFile primitive - last n lines of a file, found by scanning backwards from the end
+func tailFile(ctx context.Context, args []string) (string, error) {
+	n, err := lineCount("Tail", args)
+	if err != nil {
+		return "", err
+	}
+
+	return readFile(ctx, []string{args[0], "last_lines=" + strconv.Itoa(n)})
+}
+
+// diskUsage primitive - apparent size of all regular files below a path, like du -sb
+func diskUsage(ctx context.Context, args []string) (string, error) {
+	if len(args) != 1 {
+		return "", fmt.Errorf("DiskUsage requires exactly one argument (path)")
+	}
+
+	root, err := primitivePath(args[0])
+	if err != nil {
+		return "", err
+	}
+
+	info, err := os.Lstat(root)
+	if err != nil {
+		return "", fmt.Errorf("could not stat %s: %w", root, err)
+	}
+	if !info.IsDir() {
+		return fmt.Sprintf("%d\t%s", info.Size(), root), nil
+	}
+
+	var size, files atomic.Int64
+	err = walkParallel(ctx, root, DefaultWorkers, func(worker int, dir string, entry fs.DirEntry) error {
+		if !entry.Type().IsRegular() {
+			return nil
+		}
+		info, err := entry.Info()
+		if err != nil {
+			return nil // removed while walking
+		}
+		size.Add(info.Size())
+		files.Add(1)
+		return nil
+	})
+	if err != nil {
+		return "", fmt.Errorf("could not walk %s: %w", root, err)
+	}
+
+	return fmt.Sprintf("%d\t%s (%d files)", size.Load(), root, files.Load()), nil
+}
+
+// globPaths primitive - paths matching a shell pattern, one per line
+func globPaths(ctx context.Context, args []string) (string, error) {
+	if len(args) != 1 {
+		return "", fmt.Errorf("Glob requires exactly one argument (pattern)")
+	}
+
+	pattern, err := primitivePath(args[0])
+	if err != nil {
+		return "", err
+	}
+
+	matches, err := filepath.Glob(pattern)
+	if err != nil {
+		return "", fmt.Errorf("invalid pattern %s: %w", pattern, err)
+	}
+	if len(matches) == 0 {
+		return fmt.Sprintf("No paths match %s", pattern), nil
+	}
+
+	return strings.Join(matches, "\n") + "\n", nil
+}
+
+// grepPath primitive - lines matching a regular expression, in a file or every file below a directory
+// matches are printed as "line:text" for a file and "path:line:text" for a directory
+func grepPath(ctx context.Context, args []string) (string, error) {
+	if len(args) != 2 {
+		return "", fmt.Errorf("Grep requires exactly two arguments (path and pattern)")
+	}
+
+	root, err := primitivePath(args[0])
+	if err != nil {
+		return "", err
+	}
+	re, err := regexp.Compile(args[1])
+	if err != nil {
+		return "", fmt.Errorf("invalid pattern %s: %w", args[1], err)
+	}
+
+	info, err := os.Stat(root)
+	if err != nil {
+		return "", fmt.Errorf("could not stat %s: %w", root, err)
+	}
+
+	var out bytes.Buffer
+	if !info.IsDir() {
+		if err := grepFile(ctx, &out, root, "", re); err != nil {
+			return "", err
+		}
+	} else if err := grepTree(ctx, &out, root, re); err != nil {
+		return "", err
+	}
+
+	if out.Len() == 0 {
+		return fmt.Sprintf("No lines match %s", args[1]), nil
+	}
+	return out.String(), nil
+}
+
+// grepTree greps every regular file below root on DefaultWorkers goroutines
+// output is grouped per file, files in path order
+func grepTree(ctx context.Context, w *bytes.Buffer, root string, re *regexp.Regexp) error {
+	var mu sync.Mutex
+	var files []string
+	err := walkParallel(ctx, root, DefaultWorkers, func(worker int, dir string, entry fs.DirEntry) error {
+		if entry.Type().IsRegular() {
+			mu.Lock()
+			files = append(files, filepath.Join(dir, entry.Name()))
+			mu.Unlock()
+		}
+		return nil
+	})
+	if err != nil {
+		return fmt.Errorf("could not walk %s: %w", root, err)
+	}
+	sort.Strings(files)
+
+	outputs := make([]bytes.Buffer, len(files))
+	next := atomic.Int64{}
+	var wg sync.WaitGroup
+	for g := 0; g < DefaultWorkers && g < len(files); g++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for i := int(next.Add(1) - 1); i < len(files); i = int(next.Add(1) - 1) {
+				// unreadable files are skipped like grep -s does
+				grepFile(ctx, &outputs[i], files[i], files[i]+":", re)
+			}
+		}()
+	}
+	wg.Wait()
+	if err := ctx.Err(); err != nil {
+		return err
+	}
+
+	for i := range outputs {
+		w.Write(outputs[i].Bytes())
+	}
+	return nil
+}
+
+// grepFile writes prefix, line number and text of every line of path that matches re
+// files that look binary are skipped
+func grepFile(ctx context.Context, w *bytes.Buffer, path, prefix string, re *regexp.Regexp) error {
+	file, err := os.Open(path)
+	if err != nil {
+		return fmt.Errorf("could not open file %s: %w", path, err)
+	}
+	defer file.Close()
+
+	r := bufio.NewReaderSize(ctxReader{ctx, file}, 64<<10)
+	if head, _ := r.Peek(8 << 10); bytes.IndexByte(head, 0) >= 0 {
+		return nil
+	}
+
+	for lineNo := 1; ; lineNo++ {
+		line, err := r.ReadBytes('\n')
+		if len(line) > 0 && re.Match(bytes.TrimSuffix(line, []byte("\n"))) {
+			fmt.Fprintf(w, "%s%d:%s", prefix, lineNo, line)
+			if line[len(line)-1] != '\n' {
+				w.WriteByte('\n')
+			}
+		}
+		if err == io.EOF {
+			return nil
+		}
+		if err != nil {
+			return fmt.Errorf("could not read file %s: %w", path, err)
+		}
+	}
+}
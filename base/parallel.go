@@ -0,0 +1,211 @@
+package base
+
+import (
+	"context"
+	"fmt"
+	"path/filepath"
+	"runtime"
+	"strings"
+)
+
+// access describes how a primitive touches the file named by its first argument
+type access int
+
+const (
+	accessRead   access = iota // reads args[0]
+	accessTree                 // reads args[0] and everything below it
+	accessWrite                // modifies args[0]
+	accessGlobal               // may touch anything (shell commands, unknown primitives)
+)
+
+// primitiveAccess is used to infer ordering between commands of a parallel batch
+// primitives missing from this table are treated as accessGlobal
+var primitiveAccess = map[string]access{
+	"ReadFile":   accessRead,
+	"CreateFile": accessWrite,
+	"DeleteFile": accessWrite,
+	"WriteFile":  accessWrite,
+	"AppendFile": accessWrite,
+	"Stat":       accessRead,
+	"Head":       accessRead,
+	"Tail":       accessRead,
+	"ListDir":    accessTree,
+	"Grep":       accessTree,
+	"DiskUsage":  accessTree,
+	"WalkTree":   accessTree,
+	"Glob":       accessTree, // the tree below the pattern's first wildcard
+}
+
+// DefaultWorkers is the worker pool size used when none is given
+// primitives mostly wait on disks and child processes, so allow more workers than cpus
+var DefaultWorkers = 4 * runtime.NumCPU()
+
+// accessOf returns the access kind and cleaned target path of a command
+func (c *Command) accessOf() (access, string) {
+	kind, known := primitiveAccess[c.Name]
+	if !known || len(c.Args) == 0 || c.Args[0] == "" {
+		return accessGlobal, ""
+	}
+
+	path := c.Args[0]
+	if runtime.GOOS == "linux" {
+		if expanded, err := expandPath(path); err == nil {
+			path = expanded
+		}
+	}
+	if c.Name == "Glob" {
+		path = globRoot(path)
+	}
+	return kind, filepath.Clean(path)
+}
+
+// globRoot is the directory part of a glob pattern in front of its first wildcard
+func globRoot(pattern string) string {
+	i := strings.IndexAny(pattern, `*?[\`)
+	if i < 0 {
+		return pattern
+	}
+	return filepath.Dir(pattern[:i+1])
+}
+
+// within reports whether path is root or below it
+func within(path, root string) bool {
+	if path == root {
+		return true
+	}
+	if root == string(filepath.Separator) {
+		return strings.HasPrefix(path, root)
+	}
+	return strings.HasPrefix(path, root+string(filepath.Separator))
+}
+
+// conflicts reports whether two commands must keep their relative order
+func conflicts(ka access, pa string, kb access, pb string) bool {
+	if ka == accessGlobal || kb == accessGlobal {
+		return true
+	}
+	if ka != accessWrite && kb != accessWrite {
+		return false
+	}
+	if ka == accessTree {
+		return within(pb, pa)
+	}
+	if kb == accessTree {
+		return within(pa, pb)
+	}
+	return pa == pb
+}
+
+// dependencies returns, for every command, the indices of earlier commands it must wait for
+// commands with an explicit depends_on (even an empty one) use exactly that list,
+// all others depend on every earlier command they conflict with
+func (b *Batch) dependencies() ([][]int, error) {
+	n := len(b.Commands)
+	deps := make([][]int, n)
+	kinds := make([]access, n)
+	paths := make([]string, n)
+
+	for i := range b.Commands {
+		kinds[i], paths[i] = b.Commands[i].accessOf()
+	}
+
+	for i, cmd := range b.Commands {
+		if cmd.DependsOn != nil {
+			for _, j := range cmd.DependsOn {
+				if j < 0 || j >= i {
+					return nil, fmt.Errorf("command %d depends on %d, dependencies must refer to earlier commands", i, j)
+				}
+			}
+			deps[i] = cmd.DependsOn
+			continue
+		}
+
+		for j := 0; j < i; j++ {
+			if conflicts(kinds[j], paths[j], kinds[i], paths[i]) {
+				deps[i] = append(deps[i], j)
+			}
+		}
+	}
+
+	return deps, nil
+}
+
+// RunBatchParallel executes the batch as a dependency graph on a pool of at most workers goroutines
+// independent commands run concurrently, results keep the order of the commands
+func (b *Batch) RunBatchParallel(ctx context.Context, workers int) BatchResponse {
+	return b.runParallel(workers, b.coalesceAppends(func(i int) Response {
+		return b.Commands[i].Run(ctx)
+	}))
+}
+
+// runParallel schedules run(i) for every command according to the dependency graph
+func (b *Batch) runParallel(workers int, run func(i int) Response) BatchResponse {
+	n := len(b.Commands)
+	if workers <= 0 {
+		workers = DefaultWorkers
+	}
+	if workers > n {
+		workers = n
+	}
+	if workers <= 1 {
+		return b.run(run)
+	}
+
+	deps, err := b.dependencies()
+	if err != nil {
+		return BatchResponse{Status: StatusError, Error: err.Error()}
+	}
+
+	// remaining counts unfinished dependencies, dependents is the reverse edge list
+	remaining := make([]int, n)
+	dependents := make([][]int, n)
+	for i, ds := range deps {
+		remaining[i] = len(ds)
+		for _, j := range ds {
+			dependents[j] = append(dependents[j], i)
+		}
+	}
+
+	results := make([]Response, n)
+	ready := make(chan int, n)
+	finished := make(chan int, n)
+
+	for w := 0; w < workers; w++ {
+		go func() {
+			for i := range ready {
+				results[i] = run(i)
+				finished <- i
+			}
+		}()
+	}
+
+	for i := range remaining {
+		if remaining[i] == 0 {
+			ready <- i
+		}
+	}
+
+	// only this goroutine touches the graph, workers just run what they are handed
+	for done := 0; done < n; done++ {
+		i := <-finished
+		for _, d := range dependents[i] {
+			remaining[d]--
+			if remaining[d] == 0 {
+				ready <- d
+			}
+		}
+	}
+	close(ready)
+
+	overallStatus := StatusOK
+	for i := range results {
+		if results[i].Status != StatusOK {
+			overallStatus = StatusError
+		}
+	}
+
+	return BatchResponse{
+		Results: results,
+		Status:  overallStatus,
+	}
+}
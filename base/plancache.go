@@ -0,0 +1,162 @@
+package base
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
+	"fmt"
+	"os"
+	"path/filepath"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// planEntry is a cached command plan as stored on disk
+type planEntry struct {
+	Created time.Time `json:"created"`
+	Plan    string    `json:"plan"`
+}
+
+// planCache maps prompts to previously generated command plans
+// entries live in memory and, if a directory is given, as one json file per key on disk
+type PlanCache struct {
+	dir string
+	ttl time.Duration
+
+	mu  sync.Mutex
+	mem map[string]planEntry
+
+	hits   atomic.Uint64
+	misses atomic.Uint64
+}
+
+// NewPlanCache creates a plan cache whose entries expire after ttl
+// dir may be empty for a memory-only cache
+func NewPlanCache(dir string, ttl time.Duration) (*PlanCache, error) {
+	if dir != "" {
+		if err := os.MkdirAll(dir, 0700); err != nil {
+			return nil, fmt.Errorf("could not create plan cache directory %s: %w", dir, err)
+		}
+	}
+
+	return &PlanCache{
+		dir: dir,
+		ttl: ttl,
+		mem: make(map[string]planEntry),
+	}, nil
+}
+
+// DefaultPlanCacheDir returns the per-user plan cache directory
+func DefaultPlanCacheDir() (string, error) {
+	dir, err := os.UserCacheDir()
+	if err != nil {
+		return "", err
+	}
+	return filepath.Join(dir, "opsmith", "plans"), nil
+}
+
+// NormalizePrompt collapses whitespace so trivially different spellings share a plan
+// case is kept on purpose, prompts often carry case sensitive paths
+func NormalizePrompt(prompt string) string {
+	return strings.Join(strings.Fields(prompt), " ")
+}
+
+// PlanKey derives the cache key for a prompt generated by model with the given prompt template
+func PlanKey(prompt string, model Model, template string) string {
+	templateHash := sha256.Sum256([]byte(template))
+
+	h := sha256.New()
+	h.Write([]byte(model.String()))
+	h.Write([]byte{0})
+	h.Write(templateHash[:])
+	h.Write([]byte(NormalizePrompt(prompt)))
+	return hex.EncodeToString(h.Sum(nil))
+}
+
+// path returns the on-disk location of key
+func (pc *PlanCache) path(key string) string {
+	return filepath.Join(pc.dir, key+".json")
+}
+
+// Get returns the cached plan for key if there is a fresh one
+func (pc *PlanCache) Get(key string) (string, bool) {
+	pc.mu.Lock()
+	entry, ok := pc.mem[key]
+	pc.mu.Unlock()
+
+	if !ok && pc.dir != "" {
+		if data, err := os.ReadFile(pc.path(key)); err == nil && json.Unmarshal(data, &entry) == nil {
+			ok = true
+			pc.mu.Lock()
+			pc.mem[key] = entry
+			pc.mu.Unlock()
+		}
+	}
+
+	if ok && time.Since(entry.Created) > pc.ttl {
+		pc.remove(key)
+		ok = false
+	}
+
+	if !ok {
+		pc.misses.Add(1)
+		return "", false
+	}
+
+	pc.hits.Add(1)
+	return entry.Plan, true
+}
+
+// Put stores plan under key, the on-disk copy is replaced atomically
+func (pc *PlanCache) Put(key, plan string) error {
+	entry := planEntry{Created: time.Now(), Plan: plan}
+
+	pc.mu.Lock()
+	pc.mem[key] = entry
+	pc.mu.Unlock()
+
+	if pc.dir == "" {
+		return nil
+	}
+
+	data, err := json.Marshal(entry)
+	if err != nil {
+		return fmt.Errorf("could not marshal plan cache entry: %w", err)
+	}
+
+	tmp, err := os.CreateTemp(pc.dir, key+".*.tmp")
+	if err != nil {
+		return fmt.Errorf("could not create plan cache entry: %w", err)
+	}
+	if _, err := tmp.Write(data); err != nil {
+		tmp.Close()
+		os.Remove(tmp.Name())
+		return fmt.Errorf("could not write plan cache entry: %w", err)
+	}
+	tmp.Close()
+
+	if err := os.Rename(tmp.Name(), pc.path(key)); err != nil {
+		os.Remove(tmp.Name())
+		return fmt.Errorf("could not store plan cache entry: %w", err)
+	}
+
+	return nil
+}
+
+// remove drops key from memory and disk
+func (pc *PlanCache) remove(key string) {
+	pc.mu.Lock()
+	delete(pc.mem, key)
+	pc.mu.Unlock()
+
+	if pc.dir != "" {
+		os.Remove(pc.path(key))
+	}
+}
+
+// Stats returns the number of cache hits and misses so far
+func (pc *PlanCache) Stats() (hits, misses uint64) {
+	return pc.hits.Load(), pc.misses.Load()
+}
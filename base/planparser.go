@@ -0,0 +1,118 @@
+package base
+
+import (
+	"encoding/json"
+	"fmt"
+	"strings"
+)
+
+// PlanParser picks commands out of a {"commands": [...]} document while it is still being generated
+// every command is returned as soon as its object closes, anything before the first '{' is ignored
+type PlanParser struct {
+	depth    int
+	inString bool
+	escape   bool
+	done     bool // the top-level object has closed
+
+	lastKey  strings.Builder // last string seen directly inside the top-level object
+	keyDone  string
+	inArray  bool            // inside the top-level "commands" array
+	capture  strings.Builder // text of the command object being read
+	captured int             // number of commands returned so far
+
+	plan strings.Builder // text of the top-level object
+}
+
+// NewPlanParser creates a parser for a streamed plan
+func NewPlanParser() *PlanParser {
+	return &PlanParser{}
+}
+
+// Done reports whether the top-level plan object is syntactically complete
+func (p *PlanParser) Done() bool {
+	return p.done
+}
+
+// Plan returns the text of the plan object without the chatter around it, complete once Done
+func (p *PlanParser) Plan() string {
+	return p.plan.String()
+}
+
+// Feed consumes the next piece of generated text and returns commands completed by it
+// text following the end of the plan object is ignored
+func (p *PlanParser) Feed(text string) ([]Command, error) {
+	var commands []Command
+
+	for i := 0; i < len(text) && !p.done; i++ {
+		ch := text[i]
+		if p.depth > 0 || ch == '{' {
+			p.plan.WriteByte(ch)
+		}
+
+		// text belonging to a command object is kept verbatim
+		capturing := p.inArray && p.depth >= 3
+		if capturing {
+			p.capture.WriteByte(ch)
+		}
+
+		if p.inString {
+			switch {
+			case p.escape:
+				p.escape = false
+			case ch == '\\':
+				p.escape = true
+			case ch == '"':
+				p.inString = false
+				if p.depth == 1 {
+					p.keyDone = p.lastKey.String()
+				}
+			}
+			if p.inString && p.depth == 1 {
+				p.lastKey.WriteByte(ch)
+			}
+			continue
+		}
+
+		switch ch {
+		case '"':
+			if p.depth > 0 {
+				p.inString = true
+				if p.depth == 1 {
+					p.lastKey.Reset()
+				}
+			}
+		case '{', '[':
+			if p.depth == 0 && ch != '{' {
+				continue // still in leading chatter
+			}
+			p.depth++
+			if p.depth == 2 && ch == '[' && p.keyDone == "commands" {
+				p.inArray = true
+			}
+			if p.inArray && p.depth == 3 && ch == '{' {
+				p.capture.Reset()
+				p.capture.WriteByte(ch)
+			}
+		case '}', ']':
+			if p.depth == 0 {
+				continue
+			}
+			p.depth--
+			switch {
+			case p.inArray && p.depth == 2 && ch == '}':
+				var cmd Command
+				if err := json.Unmarshal([]byte(p.capture.String()), &cmd); err != nil {
+					return commands, fmt.Errorf("could not parse command %d: %w", p.captured+1, err)
+				}
+				p.captured++
+				commands = append(commands, cmd)
+			case p.inArray && p.depth == 1:
+				p.inArray = false
+			case p.depth == 0:
+				p.done = true
+			}
+		}
+	}
+
+	return commands, nil
+}
@@ -0,0 +1,109 @@
+package base
+
+import (
+	"reflect"
+	"testing"
+)
+
+func TestPlanParser(t *testing.T) {
+	const twoCommands = `{"commands": [{"name": "ReadFile", "args": ["/etc/hostname"]}, {"name": "CommandExec", "args": ["ls"], "depends_on": [0]}]}`
+	wantTwo := []Command{
+		{Name: "ReadFile", Args: []string{"/etc/hostname"}},
+		{Name: "CommandExec", Args: []string{"ls"}, DependsOn: []int{0}},
+	}
+
+	tests := []struct {
+		name  string
+		input string
+		want  []Command
+		plan  string // Plan() once fed, "" when the plan must not be done
+	}{
+		{"plain", twoCommands, wantTwo, twoCommands},
+		{"chatter before", "Sure, here are the commands:\n```json\n" + twoCommands, wantTwo, twoCommands},
+		{"chatter after", twoCommands + "\n```\nThis reads the file and lists {the} directory.", wantTwo, twoCommands},
+		{"chatter around", "Here you go: " + twoCommands + " hope it helps [1] {", wantTwo, twoCommands},
+		{
+			"braces in strings",
+			`{"commands": [{"name": "CommandExec", "args": ["echo '}{][' \"{\""]}]}`,
+			[]Command{{Name: "CommandExec", Args: []string{`echo '}{][' "{"`}}},
+			`{"commands": [{"name": "CommandExec", "args": ["echo '}{][' \"{\""]}]}`,
+		},
+		{
+			"escaped quotes and backslashes",
+			`{"commands": [{"name": "WriteFile", "args": ["/tmp/a", "say \"hi\" \\\" }"]}]}`,
+			[]Command{{Name: "WriteFile", Args: []string{"/tmp/a", `say "hi" \" }`}}},
+			`{"commands": [{"name": "WriteFile", "args": ["/tmp/a", "say \"hi\" \\\" }"]}]}`,
+		},
+		{
+			"other keys first",
+			`{"note": "a {tricky} \"commands\" note", "commands": [{"name": "Stat", "args": ["/"]}]}`,
+			[]Command{{Name: "Stat", Args: []string{"/"}}},
+			`{"note": "a {tricky} \"commands\" note", "commands": [{"name": "Stat", "args": ["/"]}]}`,
+		},
+		{"empty plan", `{"commands": []}`, nil, `{"commands": []}`},
+		{"incomplete", `{"commands": [{"name": "Stat", "args": ["/"]}, {"name": "Li`, []Command{{Name: "Stat", Args: []string{"/"}}}, ""},
+		{"only chatter", "I can't help with that.", nil, ""},
+	}
+
+	feeds := map[string]func(string) []string{
+		"whole": func(s string) []string { return []string{s} },
+		"bytes": func(s string) []string {
+			pieces := make([]string, len(s))
+			for i := range s {
+				pieces[i] = s[i : i+1]
+			}
+			return pieces
+		},
+		"tokens": func(s string) []string {
+			var pieces []string
+			for len(s) > 3 {
+				pieces = append(pieces, s[:3])
+				s = s[3:]
+			}
+			return append(pieces, s)
+		},
+	}
+
+	for _, tt := range tests {
+		for feedName, split := range feeds {
+			t.Run(tt.name+"/"+feedName, func(t *testing.T) {
+				p := NewPlanParser()
+				var got []Command
+				for _, piece := range split(tt.input) {
+					commands, err := p.Feed(piece)
+					if err != nil {
+						t.Fatalf("feed: %v", err)
+					}
+					got = append(got, commands...)
+				}
+
+				if !reflect.DeepEqual(got, tt.want) {
+					t.Errorf("commands = %+v, want %+v", got, tt.want)
+				}
+				if done := tt.plan != ""; p.Done() != done {
+					t.Fatalf("Done() = %v, want %v", p.Done(), done)
+				}
+				if tt.plan != "" && p.Plan() != tt.plan {
+					t.Errorf("Plan() = %q, want %q", p.Plan(), tt.plan)
+				}
+			})
+		}
+	}
+}
+
+func TestPlanParserMalformedCommand(t *testing.T) {
+	p := NewPlanParser()
+	_, err := p.Feed(`{"commands": [{"name": "Stat", "args": "not a list"}]}`)
+	if err == nil {
+		t.Fatal("malformed command parsed without error")
+	}
+}
+
+func TestPlanParserIgnoresTextAfterDone(t *testing.T) {
+	p := NewPlanParser()
+	p.Feed(`{"commands": []}`)
+	commands, err := p.Feed(`{"commands": [{"name": "Stat", "args": ["/"]}]}`)
+	if err != nil || len(commands) != 0 {
+		t.Fatalf("text after the plan produced %v, %v", commands, err)
+	}
+}
@@ -0,0 +1,16 @@
+//go:build !linux
+
+package base
+
+import (
+	"os"
+	"os/exec"
+)
+
+// setProcessGroup is a no-op, only the process itself is killed here
+func setProcessGroup(cmd *exec.Cmd) {}
+
+// killProcessGroup kills the process
+func killProcessGroup(p *os.Process) error {
+	return p.Kill()
+}
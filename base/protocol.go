@@ -0,0 +1,291 @@
+package base
+
+import (
+	"bufio"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"net"
+	"sync"
+	"sync/atomic"
+)
+
+// frame types exchanged between master and slave
+const (
+	FrameBatch         byte = 1 // master -> slave, payload is a batch
+	FrameBatchResponse byte = 2 // slave -> master, payload is a batch response
+	FrameChunk         byte = 3 // slave -> master, streamed output of one command, see ChunkWriter
+	FrameRaw           byte = 4 // slave -> master, raw file bytes sent with sendfile, see rawfile.go
+	FrameHello         byte = 5 // both ways once after connecting, payload is a capability mask
+	FrameCancel        byte = 6 // master -> slave, stop the batch with the frame's id, no payload
+)
+
+// flags carried by batch frames
+const (
+	FlagParallel   byte = 1 << 0 // run the batch as a dependency graph on the slave's worker pool
+	FlagStream     byte = 1 << 1 // stream primitive output back as chunk frames while it is produced
+	FlagRaw        byte = 1 << 2 // with FlagStream, send regular files as raw frames straight from the page cache
+	FlagBinary     byte = 1 << 3 // payload uses the binary codec instead of json (batch and response frames)
+	FlagCompressed byte = 1 << 4 // payload is gzip compressed, see compress.go
+)
+
+// ConnQueueDepth is how many batches a slave queues per connection, a client keeps at most
+// that many unanswered so pipelined batches never find the queue full
+const ConnQueueDepth = 64
+
+// capabilities negotiated with hello frames, the master announces what it wants
+// and the slave answers with the subset it supports
+const (
+	CapBinary uint32 = 1 << 0 // batch responses may use the binary codec
+	CapGzip   uint32 = 1 << 1 // large response and chunk frames may be gzip compressed
+)
+
+// SupportedCaps are the capabilities this build implements
+const SupportedCaps = CapBinary | CapGzip
+
+// EncodeHello builds a hello frame announcing caps
+func EncodeHello(caps uint32) Frame {
+	payload := make([]byte, 4)
+	binary.BigEndian.PutUint32(payload, caps)
+	return Frame{Type: FrameHello, Payload: payload}
+}
+
+// DecodeHello returns the capabilities carried by a hello frame
+func DecodeHello(f Frame) (uint32, error) {
+	if f.Type != FrameHello || len(f.Payload) < 4 {
+		return 0, fmt.Errorf("malformed hello frame")
+	}
+	return binary.BigEndian.Uint32(f.Payload), nil
+}
+
+// every frame starts with a fixed header:
+// | length (4 bytes) | type (1 byte) | flags (1 byte) | request id (8 bytes) |
+// length is the payload length only, all integers are big endian
+const frameHeaderSize = 14
+
+// MaxFrameSize bounds a single frame payload so a corrupt header can't make us allocate gigabytes
+const MaxFrameSize = 256 << 20
+
+// MaxChunkSize bounds the output carried by a single chunk frame
+const MaxChunkSize = 64 << 10
+
+// chunk frames carry | command index (4 bytes) | output bytes |
+const chunkHeaderSize = 4
+
+// frame is a single length-prefixed message on the wire
+type Frame struct {
+	ID      uint64
+	Type    byte
+	Flags   byte
+	Payload []byte
+
+	// RawLen is the number of raw bytes following a FrameRaw header, Payload then only holds
+	// the command index; they must be consumed with ReadRaw before the next ReadFrame
+	RawLen int64
+}
+
+// frameConn wraps a connection with buffered frame reads and serialized frame writes
+type FrameConn struct {
+	conn net.Conn
+	r    *bufio.Reader
+	wmu  sync.Mutex
+	caps atomic.Uint32 // negotiated capabilities, decide how outgoing frames are encoded
+}
+
+// NewFrameConn wraps conn for frame based communication
+func NewFrameConn(conn net.Conn) *FrameConn {
+	return &FrameConn{
+		conn: conn,
+		r:    bufio.NewReaderSize(conn, 64<<10),
+	}
+}
+
+// SetCaps records the capabilities negotiated for this connection
+func (fc *FrameConn) SetCaps(caps uint32) {
+	fc.caps.Store(caps)
+}
+
+// Caps returns the capabilities negotiated for this connection
+func (fc *FrameConn) Caps() uint32 {
+	return fc.caps.Load()
+}
+
+// shouldCompress reports whether a payload of n bytes for a frame of this type gets compressed
+func (fc *FrameConn) shouldCompress(frameType byte, n int) bool {
+	return n >= CompressThreshold && compressible(frameType) && fc.caps.Load()&CapGzip != 0
+}
+
+// Conn returns the underlying connection
+func (fc *FrameConn) Conn() net.Conn {
+	return fc.conn
+}
+
+// ReadFrame reads the next frame, it must only be called from a single goroutine
+func (fc *FrameConn) ReadFrame() (Frame, error) {
+	f, n, err := readFrameHeader(fc.r)
+	if err != nil {
+		return Frame{}, err
+	}
+
+	if f.Type == FrameRaw {
+		if n < chunkHeaderSize {
+			return Frame{}, fmt.Errorf("raw frame too short (%d bytes)", n)
+		}
+		f.Payload = make([]byte, chunkHeaderSize)
+		f.RawLen = int64(n) - chunkHeaderSize
+	} else {
+		if n > MaxFrameSize {
+			return Frame{}, fmt.Errorf("frame payload of %d bytes exceeds maximum of %d bytes", n, MaxFrameSize)
+		}
+		f.Payload = make([]byte, n)
+	}
+
+	if _, err := io.ReadFull(fc.r, f.Payload); err != nil {
+		return Frame{}, fmt.Errorf("could not read frame payload: %w", err)
+	}
+	return f, nil
+}
+
+// WriteFrame writes a frame, safe for concurrent use
+// large payloads are compressed when the connection negotiated it
+func (fc *FrameConn) WriteFrame(f Frame) error {
+	if fc.shouldCompress(f.Type, len(f.Payload)) {
+		if compressed, ok := compress(f.Payload); ok {
+			f.Payload = compressed
+			f.Flags |= FlagCompressed
+		}
+	}
+
+	fc.wmu.Lock()
+	defer fc.wmu.Unlock()
+	return WriteFrame(fc.conn, f)
+}
+
+// Close closes the underlying connection
+func (fc *FrameConn) Close() error {
+	return fc.conn.Close()
+}
+
+// putFrameHeader encodes the header for a frame with a payload of n bytes
+func putFrameHeader(hdr []byte, f Frame, n int) {
+	binary.BigEndian.PutUint32(hdr[0:4], uint32(n))
+	hdr[4] = f.Type
+	hdr[5] = f.Flags
+	binary.BigEndian.PutUint64(hdr[6:14], f.ID)
+}
+
+// WriteFrame writes a single frame to w; header and payload go out in one vectored write
+func WriteFrame(w io.Writer, f Frame) error {
+	return writeFrameParts(w, f, f.Payload)
+}
+
+// writeFrameParts writes a frame whose payload is the concatenation of parts
+func writeFrameParts(w io.Writer, f Frame, parts ...[]byte) error {
+	n := 0
+	for _, part := range parts {
+		n += len(part)
+	}
+	if n > MaxFrameSize {
+		return fmt.Errorf("frame payload of %d bytes exceeds maximum of %d bytes", n, MaxFrameSize)
+	}
+
+	var hdr [frameHeaderSize]byte
+	putFrameHeader(hdr[:], f, n)
+
+	bufs := append(net.Buffers{hdr[:]}, parts...)
+	if _, err := bufs.WriteTo(w); err != nil {
+		return fmt.Errorf("could not write frame: %w", err)
+	}
+	return nil
+}
+
+// chunkWriter turns writes into chunk frames for one command of a request
+type chunkWriter struct {
+	fc    *FrameConn
+	id    uint64
+	index uint32
+	raw   bool // regular files copied in are sent as raw frames
+}
+
+// ChunkWriter returns a writer that sends everything written to it as chunk frames
+// for command index of request id, large writes are split at MaxChunkSize
+// with raw set, regular files copied into it with io.Copy go out as FrameRaw via sendfile
+func (fc *FrameConn) ChunkWriter(id uint64, index int, raw bool) io.Writer {
+	return &chunkWriter{fc: fc, id: id, index: uint32(index), raw: raw}
+}
+
+func (cw *chunkWriter) Write(p []byte) (int, error) {
+	var idx [chunkHeaderSize]byte
+	binary.BigEndian.PutUint32(idx[:], cw.index)
+
+	written := 0
+	for len(p) > 0 {
+		n := len(p)
+		if n > MaxChunkSize {
+			n = MaxChunkSize
+		}
+
+		f := Frame{ID: cw.id, Type: FrameChunk}
+		data := p[:n]
+		if cw.fc.shouldCompress(FrameChunk, n) {
+			if compressed, ok := compress(data); ok {
+				data = compressed
+				f.Flags |= FlagCompressed
+			}
+		}
+
+		cw.fc.wmu.Lock()
+		err := writeFrameParts(cw.fc.conn, f, idx[:], data)
+		cw.fc.wmu.Unlock()
+		if err != nil {
+			return written, err
+		}
+
+		written += n
+		p = p[n:]
+	}
+
+	return written, nil
+}
+
+// ParseChunk splits a chunk frame payload into command index and output
+func ParseChunk(payload []byte) (int, []byte, error) {
+	if len(payload) < chunkHeaderSize {
+		return 0, nil, fmt.Errorf("chunk frame too short (%d bytes)", len(payload))
+	}
+	return int(binary.BigEndian.Uint32(payload[:chunkHeaderSize])), payload[chunkHeaderSize:], nil
+}
+
+// readFrameHeader reads a frame header and returns the frame without payload and the payload length
+func readFrameHeader(r io.Reader) (Frame, uint32, error) {
+	var hdr [frameHeaderSize]byte
+	if _, err := io.ReadFull(r, hdr[:]); err != nil {
+		return Frame{}, 0, err
+	}
+
+	f := Frame{
+		Type:  hdr[4],
+		Flags: hdr[5],
+		ID:    binary.BigEndian.Uint64(hdr[6:14]),
+	}
+	return f, binary.BigEndian.Uint32(hdr[0:4]), nil
+}
+
+// ReadFrame reads a single frame from r, raw frames are not supported here, use FrameConn
+func ReadFrame(r io.Reader) (Frame, error) {
+	f, n, err := readFrameHeader(r)
+	if err != nil {
+		return Frame{}, err
+	}
+
+	if n > MaxFrameSize {
+		return Frame{}, fmt.Errorf("frame payload of %d bytes exceeds maximum of %d bytes", n, MaxFrameSize)
+	}
+
+	f.Payload = make([]byte, n)
+	if _, err := io.ReadFull(r, f.Payload); err != nil {
+		return Frame{}, fmt.Errorf("could not read frame payload: %w", err)
+	}
+
+	return f, nil
+}
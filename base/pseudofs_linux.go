@@ -0,0 +1,29 @@
+package base
+
+import "syscall"
+
+// filesystem magic numbers of kernel pseudo filesystems, from linux/magic.h
+var pseudoFSMagic = map[uint32]bool{
+	0x9fa0:     true, // proc
+	0x62656572: true, // sysfs
+	0x64626720: true, // debugfs
+	0x74726163: true, // tracefs
+	0x73636673: true, // securityfs
+	0x27e0eb:   true, // cgroup
+	0x63677270: true, // cgroup2
+	0x62656570: true, // configfs
+	0xcafe4a11: true, // bpf
+	0x6165676c: true, // pstore
+	0x65735543: true, // fusectl
+	0x1cd1:     true, // devpts
+}
+
+// onPseudoFS reports whether path lives on a kernel pseudo filesystem such as proc or sysfs,
+// whose files report sizes and times that have nothing to do with their content
+func onPseudoFS(path string) bool {
+	var st syscall.Statfs_t
+	if err := syscall.Statfs(path, &st); err != nil {
+		return false
+	}
+	return pseudoFSMagic[uint32(st.Type)]
+}
@@ -0,0 +1,8 @@
+//go:build !linux
+
+package base
+
+// onPseudoFS has no pseudo filesystems to detect here, files are judged by type and size only
+func onPseudoFS(path string) bool {
+	return false
+}
@@ -0,0 +1,150 @@
+package base
+
+import (
+	"encoding/binary"
+	"fmt"
+	"io"
+	"os"
+)
+
+// raw frames carry file contents without any encoding:
+// | frame header (type FrameRaw) | command index (4 bytes) | file bytes |
+// the sender hands the file to the kernel (sendfile on linux via net.TCPConn.ReadFrom)
+// and the receiver can splice the bytes into a file, so they never pass through user space
+
+// MaxRawFrameSize bounds the file bytes carried by one raw frame, larger files use several frames
+const MaxRawFrameSize = 1 << 30
+
+// ReadFrom sends regular files as raw frames when the writer allows it and falls back to chunks
+func (cw *chunkWriter) ReadFrom(r io.Reader) (int64, error) {
+	// ranged reads come in as a limited file
+	limit := int64(-1)
+	if lr, ok := r.(*io.LimitedReader); ok {
+		if file, ok := lr.R.(*os.File); ok {
+			r, limit = file, lr.N
+		}
+	}
+
+	if file, ok := r.(*os.File); ok && cw.raw {
+		if info, err := file.Stat(); err == nil && stableFile(file.Name(), info) {
+			if offset, err := file.Seek(0, io.SeekCurrent); err == nil {
+				n := info.Size() - offset
+				if limit >= 0 && limit < n {
+					n = limit
+				}
+				return cw.fc.sendFile(cw.id, cw.index, file, n)
+			}
+		}
+	}
+
+	if limit >= 0 {
+		r = &io.LimitedReader{R: r, N: limit}
+	}
+
+	// hide our ReadFrom so io.Copy uses plain writes
+	return io.Copy(struct{ io.Writer }{cw}, r)
+}
+
+// stableFile reports whether the size and times of a file describe its content: it is a
+// non-empty regular file outside the pseudo filesystems, whose files claim sizes of 0 or 4096
+// whatever they hold; only those can be sent raw, the frame length is taken from the size,
+// and only those are kept in the read cache
+func stableFile(path string, info os.FileInfo) bool {
+	return info.Mode().IsRegular() && info.Size() > 0 && !onPseudoFS(path)
+}
+
+// sendFile sends the next n bytes of file as raw frames for command index of request id
+func (fc *FrameConn) sendFile(id uint64, index uint32, file *os.File, n int64) (int64, error) {
+	var sent int64
+	for n > 0 {
+		segment := n
+		if segment > MaxRawFrameSize {
+			segment = MaxRawFrameSize
+		}
+
+		fc.wmu.Lock()
+		err := fc.writeRawSegment(id, index, file, segment)
+		fc.wmu.Unlock()
+		if err != nil {
+			return sent, err
+		}
+
+		sent += segment
+		n -= segment
+	}
+
+	return sent, nil
+}
+
+// writeRawSegment writes one raw frame, the caller holds wmu
+// a file that shrank under us leaves the frame short of the length already on the wire;
+// rather than padding it with bytes the file never held, the connection is closed
+func (fc *FrameConn) writeRawSegment(id uint64, index uint32, file *os.File, n int64) error {
+	// the frame length can't be taken back once written, check the file still holds n bytes
+	if info, err := file.Stat(); err == nil {
+		if offset, err := file.Seek(0, io.SeekCurrent); err == nil && info.Size()-offset < n {
+			return fmt.Errorf("file %s shrank before sending (%d of %d bytes left)", file.Name(), info.Size()-offset, n)
+		}
+	}
+
+	var hdr [frameHeaderSize + chunkHeaderSize]byte
+	putFrameHeader(hdr[:frameHeaderSize], Frame{ID: id, Type: FrameRaw}, chunkHeaderSize+int(n))
+	binary.BigEndian.PutUint32(hdr[frameHeaderSize:], index)
+
+	if _, err := fc.conn.Write(hdr[:]); err != nil {
+		return fmt.Errorf("could not write raw frame header: %w", err)
+	}
+
+	// conn is a *net.TCPConn, its ReadFrom turns this into sendfile
+	copied, err := io.Copy(fc.conn, &io.LimitedReader{R: file, N: n})
+	if err != nil {
+		return fmt.Errorf("could not send file %s: %w", file.Name(), err)
+	}
+
+	if copied < n {
+		fc.conn.Close()
+		return fmt.Errorf("file %s shrank while sending (%d of %d bytes sent), connection closed", file.Name(), copied, n)
+	}
+
+	return nil
+}
+
+// ReadRaw copies the n raw bytes following a FrameRaw header to dst
+// when dst is an *os.File, the bytes go from the socket to the file with splice
+// if dst fails the remaining bytes are discarded so the connection stays in sync and the
+// write error is returned as writeErr; err is only set when the connection itself failed
+func (fc *FrameConn) ReadRaw(dst io.Writer, n int64) (writeErr error, err error) {
+	// whatever the frame reader already buffered has to come from there
+	buffered := int64(fc.r.Buffered())
+	if buffered > n {
+		buffered = n
+	}
+	if buffered > 0 {
+		copied, err := io.CopyN(dst, fc.r, buffered)
+		if err != nil {
+			// buffered bytes can't fail to read, so this is dst failing
+			writeErr = err
+			dst = io.Discard
+			if _, err := io.CopyN(dst, fc.r, buffered-copied); err != nil {
+				return writeErr, err
+			}
+		}
+	}
+
+	// the rest is read from the connection directly, bypassing the buffer
+	rest := &io.LimitedReader{R: fc.conn, N: n - buffered}
+	if _, err := io.Copy(dst, rest); err != nil {
+		// drain what is left; if that fails too the connection is broken
+		if _, derr := io.Copy(io.Discard, rest); derr != nil {
+			return writeErr, derr
+		}
+		if writeErr == nil {
+			writeErr = err
+		}
+	}
+	if rest.N > 0 {
+		return writeErr, io.ErrUnexpectedEOF
+	}
+
+	return writeErr, nil
+}
@@ -0,0 +1,188 @@
+package base
+
+import (
+	"container/list"
+	"context"
+	"os"
+	"strings"
+	"sync"
+	"sync/atomic"
+)
+
+// the read cache keeps results of read-only primitives in the slave, so repeated diagnostics
+// don't go back to disk; an entry is only used while the file still has the device, inode,
+// size, mtime and ctime it had when it was read, so any write, rename or chmod invalidates it
+//
+// only non-empty regular files on real filesystems are cached: procfs, sysfs and the like
+// keep the same identity while their content changes, see stableFile
+// ListDir is not cached: a directory's mtime doesn't change when a file inside it grows
+
+// cachedPrimitives maps every cacheable primitive to how its path argument is checked
+var cachedPrimitives = map[string]func(string) (os.FileInfo, error){
+	"ReadFile": os.Stat,
+	"Head":     os.Stat,
+	"Tail":     os.Stat,
+	"Stat":     os.Lstat,
+}
+
+// fileIdentity is what an entry is validated against
+type fileIdentity struct {
+	dev, ino     uint64
+	size         int64
+	mtime, ctime int64 // nanoseconds
+}
+
+func identityOf(info os.FileInfo) fileIdentity {
+	id := fileIdentity{size: info.Size(), mtime: info.ModTime().UnixNano()}
+	id.dev, id.ino, id.ctime = fileIdentityOf(info)
+	return id
+}
+
+// readCacheEntry is one cached primitive result
+type readCacheEntry struct {
+	key  string
+	id   fileIdentity
+	data string
+}
+
+// ReadCache is an LRU cache of read-only primitive results with a byte budget
+type ReadCache struct {
+	budget int64
+
+	mu      sync.Mutex
+	used    int64
+	lru     *list.List // most recently used at the front
+	entries map[string]*list.Element
+
+	hits   atomic.Uint64
+	misses atomic.Uint64
+}
+
+// readCache is used by Command.Run when set, see UseReadCache
+var readCache *ReadCache
+
+// UseReadCache makes Command.Run serve read-only primitives from cache, nil turns caching off
+func UseReadCache(cache *ReadCache) {
+	readCache = cache
+}
+
+// NewReadCache creates a read cache holding at most budget bytes of results
+func NewReadCache(budget int64) *ReadCache {
+	return &ReadCache{
+		budget:  budget,
+		lru:     list.New(),
+		entries: make(map[string]*list.Element),
+	}
+}
+
+// cacheKey identifies a primitive call, NUL can't appear in paths or arguments
+func cacheKey(name string, args []string) string {
+	return name + "\x00" + strings.Join(args, "\x00")
+}
+
+// call returns the result of fn for the command, from cache when the file is unchanged
+func (rc *ReadCache) call(ctx context.Context, c *Command, stat func(string) (os.FileInfo, error), fn primitiveFunc) (string, error) {
+	if len(c.Args) == 0 {
+		return fn(ctx, c.Args)
+	}
+	path, err := primitivePath(c.Args[0])
+	if err != nil {
+		return fn(ctx, c.Args)
+	}
+
+	before, err := stat(path)
+	if err != nil {
+		return fn(ctx, c.Args) // let the primitive report the error
+	}
+	if !stableFile(path, before) {
+		return fn(ctx, c.Args)
+	}
+	id := identityOf(before)
+	key := cacheKey(c.Name, c.Args)
+
+	if data, ok := rc.get(key, id); ok {
+		rc.hits.Add(1)
+		return data, nil
+	}
+	rc.misses.Add(1)
+
+	data, err := fn(ctx, c.Args)
+	if err != nil {
+		return data, err
+	}
+
+	// only keep results of files that did not change while being read
+	if after, err := stat(path); err == nil && identityOf(after) == id {
+		rc.put(key, id, data)
+	}
+	return data, nil
+}
+
+// get returns the cached data of key if it was read from the same version of the file
+func (rc *ReadCache) get(key string, id fileIdentity) (string, bool) {
+	rc.mu.Lock()
+	defer rc.mu.Unlock()
+
+	elem, ok := rc.entries[key]
+	if !ok {
+		return "", false
+	}
+	entry := elem.Value.(*readCacheEntry)
+	if entry.id != id {
+		rc.remove(elem)
+		return "", false
+	}
+	rc.lru.MoveToFront(elem)
+	return entry.data, true
+}
+
+// put stores data under key, evicting least recently used entries to stay within the budget
+// results larger than a quarter of the budget are not cached, they would flush everything else
+func (rc *ReadCache) put(key string, id fileIdentity, data string) {
+	size := int64(len(key) + len(data))
+	if size > rc.budget/4 {
+		return
+	}
+
+	rc.mu.Lock()
+	defer rc.mu.Unlock()
+
+	if elem, ok := rc.entries[key]; ok {
+		rc.remove(elem)
+	}
+	rc.entries[key] = rc.lru.PushFront(&readCacheEntry{key: key, id: id, data: data})
+	rc.used += size
+
+	for rc.used > rc.budget {
+		rc.remove(rc.lru.Back())
+	}
+}
+
+// remove drops an entry, the caller holds mu
+func (rc *ReadCache) remove(elem *list.Element) {
+	entry := rc.lru.Remove(elem).(*readCacheEntry)
+	delete(rc.entries, entry.key)
+	rc.used -= int64(len(entry.key) + len(entry.data))
+}
+
+// ReadCacheStats is a snapshot of the read cache counters
+type ReadCacheStats struct {
+	Hits, Misses uint64
+	Entries      int
+	Bytes        int64
+}
+
+// HitRate is the share of lookups answered from cache
+func (s ReadCacheStats) HitRate() float64 {
+	if s.Hits+s.Misses == 0 {
+		return 0
+	}
+	return float64(s.Hits) / float64(s.Hits+s.Misses)
+}
+
+// Stats returns the current counters and size of the cache
+func (rc *ReadCache) Stats() ReadCacheStats {
+	rc.mu.Lock()
+	defer rc.mu.Unlock()
+	return ReadCacheStats{Hits: rc.hits.Load(), Misses: rc.misses.Load(), Entries: len(rc.entries), Bytes: rc.used}
+}
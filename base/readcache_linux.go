@@ -0,0 +1,15 @@
+package base
+
+import (
+	"os"
+	"syscall"
+)
+
+// fileIdentityOf returns device, inode and status change time of a file
+func fileIdentityOf(info os.FileInfo) (dev, ino uint64, ctime int64) {
+	st, ok := info.Sys().(*syscall.Stat_t)
+	if !ok {
+		return 0, 0, 0
+	}
+	return uint64(st.Dev), uint64(st.Ino), st.Ctim.Nano()
+}
@@ -0,0 +1,10 @@
+//go:build !linux
+
+package base
+
+import "os"
+
+// fileIdentityOf has no inode to offer here, entries are validated by size and mtime only
+func fileIdentityOf(info os.FileInfo) (dev, ino uint64, ctime int64) {
+	return 0, 0, 0
+}
@@ -0,0 +1,268 @@
+package base
+
+import (
+	"bytes"
+	"context"
+	"fmt"
+	"io"
+	"os"
+	"strconv"
+	"strings"
+)
+
+// ReadFile takes optional key=value arguments after the path to read part of a file:
+//   offset=<n> length=<n>   bytes from offset on, length of them at most
+//   last_bytes=<n>          the last n bytes
+//   last_lines=<n>          the last n lines, found by scanning backwards from the end
+// none of them reads more of the file than it returns, except tails of files whose size can't
+// be trusted, like those in /proc reporting 0: they are read forward once keeping only the tail
+
+// tailBlock is how much is read per step when scanning backwards for line starts
+const tailBlock = 64 << 10
+
+// readRange is the part of a file ReadFile returns
+type readRange struct {
+	offset    int64
+	length    int64 // negative means up to the end of the file
+	lastBytes int64 // negative means not set
+	lastLines int   // negative means not set
+}
+
+// parseReadRange parses the arguments following ReadFile's path
+func parseReadRange(args []string) (readRange, error) {
+	rng := readRange{length: -1, lastBytes: -1, lastLines: -1}
+	for _, arg := range args {
+		key, value, found := strings.Cut(arg, "=")
+		if !found {
+			return rng, fmt.Errorf("invalid range %s, expected key=value", arg)
+		}
+		n, err := strconv.ParseInt(value, 10, 64)
+		if err != nil || n < 0 {
+			return rng, fmt.Errorf("invalid %s %s", key, value)
+		}
+
+		switch key {
+		case "offset":
+			rng.offset = n
+		case "length":
+			rng.length = n
+		case "last_bytes":
+			rng.lastBytes = n
+		case "last_lines":
+			rng.lastLines = int(n)
+		default:
+			return rng, fmt.Errorf("unknown range %s", key)
+		}
+	}
+
+	tail := rng.lastBytes >= 0 || rng.lastLines >= 0
+	if tail && (rng.offset != 0 || rng.length >= 0) || rng.lastBytes >= 0 && rng.lastLines >= 0 {
+		return rng, fmt.Errorf("use either offset/length, last_bytes or last_lines")
+	}
+	return rng, nil
+}
+
+// openRange opens the file named by ReadFile arguments, positions it at the start of the
+// requested range and returns how many bytes of it to read
+func openRange(args []string) (*os.File, string, int64, error) {
+	if len(args) < 1 {
+		return nil, "", 0, fmt.Errorf("readFile requires a file path and optional range arguments")
+	}
+	rng, err := parseReadRange(args[1:])
+	if err != nil {
+		return nil, "", 0, err
+	}
+
+	file, filepath, err := openForRead(args[:1])
+	if err != nil {
+		return nil, "", 0, err
+	}
+
+	start, n, err := rng.resolve(file)
+	if err != nil {
+		file.Close()
+		return nil, "", 0, fmt.Errorf("could not position in file %s: %w", filepath, err)
+	}
+	if start > 0 {
+		if _, err := file.Seek(start, io.SeekStart); err != nil {
+			file.Close()
+			return nil, "", 0, fmt.Errorf("could not seek in file %s: %w", filepath, err)
+		}
+	}
+
+	return file, filepath, n, nil
+}
+
+// resolve turns the range into a start offset and byte count for file
+// a negative count means read to the end, used for whole reads and non-seekable files
+func (rng readRange) resolve(file *os.File) (int64, int64, error) {
+	if rng.lastBytes < 0 && rng.lastLines < 0 {
+		return rng.offset, rng.length, nil
+	}
+
+	info, err := file.Stat()
+	if err != nil {
+		return 0, 0, err
+	}
+	size := info.Size()
+
+	if rng.lastBytes >= 0 {
+		if rng.lastBytes > size {
+			return 0, size, nil
+		}
+		return size - rng.lastBytes, rng.lastBytes, nil
+	}
+
+	start, err := tailOffset(file, size, rng.lastLines)
+	if err != nil {
+		return 0, 0, err
+	}
+	return start, size - start, nil
+}
+
+// tailOffset returns where the last n lines of a file of the given size start
+// the file is scanned backwards in tailBlock steps, a final newline does not start another line
+func tailOffset(file *os.File, size int64, n int) (int64, error) {
+	if n == 0 {
+		return size, nil
+	}
+
+	buf := make([]byte, tailBlock)
+	end := size
+	for end > 0 {
+		step := int64(tailBlock)
+		if step > end {
+			step = end
+		}
+		pos := end - step
+
+		block := buf[:step]
+		if _, err := file.ReadAt(block, pos); err != nil && err != io.EOF {
+			return 0, err
+		}
+		if end == size && block[len(block)-1] == '\n' {
+			block = block[:len(block)-1]
+		}
+
+		for {
+			i := bytes.LastIndexByte(block, '\n')
+			if i < 0 {
+				break
+			}
+			if n--; n == 0 {
+				return pos + int64(i) + 1, nil
+			}
+			block = block[:i]
+		}
+		end = pos
+	}
+
+	return 0, nil
+}
+
+// readPseudoTail returns the tail ReadFile arguments ask for when the file fails stableFile,
+// ok is false for every other read, which goes through openRange
+func readPseudoTail(ctx context.Context, args []string) ([]byte, bool, error) {
+	if len(args) < 2 {
+		return nil, false, nil
+	}
+	rng, err := parseReadRange(args[1:])
+	if err != nil || rng.lastBytes < 0 && rng.lastLines < 0 {
+		return nil, false, nil // openRange reports the error
+	}
+
+	file, filepath, err := openForRead(args[:1])
+	if err != nil {
+		return nil, true, err
+	}
+	defer file.Close()
+
+	info, err := file.Stat()
+	if err == nil && stableFile(filepath, info) {
+		return nil, false, nil
+	}
+
+	tail, err := rng.readTail(ctxReader{ctx, file})
+	if err != nil {
+		return nil, true, fmt.Errorf("could not read file %s: %w", filepath, err)
+	}
+	return tail, true, nil
+}
+
+// readTail reads r to its end and returns the last bytes or lines the range asks for
+// the window read so far is cut back to them whenever it doubled, so about twice the tail is held
+func (rng readRange) readTail(r io.Reader) ([]byte, error) {
+	trim := func(window []byte) []byte {
+		start := 0
+		if rng.lastBytes >= 0 {
+			if int64(len(window)) > rng.lastBytes {
+				start = len(window) - int(rng.lastBytes)
+			}
+		} else {
+			start = lastLinesStart(window, rng.lastLines)
+		}
+		return append(window[:0], window[start:]...)
+	}
+
+	var window []byte
+	buf := make([]byte, tailBlock)
+	next := 2 * tailBlock
+	for {
+		n, err := r.Read(buf)
+		window = append(window, buf[:n]...)
+		if err == io.EOF {
+			return trim(window), nil
+		}
+		if err != nil {
+			return nil, err
+		}
+		if len(window) >= next {
+			window = trim(window)
+			next = 2*len(window) + tailBlock
+		}
+	}
+}
+
+// lastLinesStart returns where the last n lines of data start, like tailOffset does for files
+// cutting there mid-read is safe, more data only extends the last line or adds lines after it
+func lastLinesStart(data []byte, n int) int {
+	if n == 0 {
+		return len(data)
+	}
+
+	end := len(data)
+	if end > 0 && data[end-1] == '\n' {
+		end--
+	}
+	for {
+		i := bytes.LastIndexByte(data[:end], '\n')
+		if i < 0 {
+			return 0
+		}
+		if n--; n == 0 {
+			return i + 1
+		}
+		end = i
+	}
+}
+
+// ctxReader fails reads once ctx is done
+type ctxReader struct {
+	ctx context.Context
+	r   io.Reader
+}
+
+func (cr ctxReader) Read(p []byte) (int, error) {
+	if err := cr.ctx.Err(); err != nil {
+		return 0, err
+	}
+	return cr.r.Read(p)
+}
+
+// limitRange wraps file so at most n bytes are read, negative n means no limit
+func limitRange(file *os.File, n int64) io.Reader {
+	if n < 0 {
+		return file
+	}
+	return &io.LimitedReader{R: file, N: n}
+}
@@ -0,0 +1,122 @@
+package base
+
+import (
+	"context"
+	"os"
+	"path/filepath"
+	"strings"
+	"testing"
+)
+
+// naiveTail returns the last n lines of data the way tail -n does
+func naiveTail(data string, n int) string {
+	if n == 0 {
+		return ""
+	}
+	lines := strings.SplitAfter(data, "\n")
+	if lines[len(lines)-1] == "" {
+		lines = lines[:len(lines)-1]
+	}
+	if len(lines) > n {
+		lines = lines[len(lines)-n:]
+	}
+	return strings.Join(lines, "")
+}
+
+func TestTailOffset(t *testing.T) {
+	line := strings.Repeat("x", 99) + "\n" // 100 bytes
+	tests := []struct {
+		name string
+		data string
+	}{
+		{"empty", ""},
+		{"no newline", "just one line"},
+		{"single newline", "\n"},
+		{"short lines", "a\nb\nc\n"},
+		{"no final newline", "a\nb\nc"},
+		{"empty lines", "\n\n\na\n\n"},
+		{"newline ends a block", strings.Repeat("y", tailBlock-1) + "\n" + "tail\n"},
+		{"newline starts a block", strings.Repeat("y", tailBlock) + "\nb\n"},
+		{"line spans blocks", "a\n" + strings.Repeat("z", 3*tailBlock) + "\nb\n"},
+		{"file of a block", strings.Repeat("w", tailBlock-1) + "\n"},
+		{"many blocks", strings.Repeat(line, 3*tailBlock/100+7)},
+	}
+
+	dir := t.TempDir()
+	for _, tt := range tests {
+		path := filepath.Join(dir, "data")
+		if err := os.WriteFile(path, []byte(tt.data), 0o644); err != nil {
+			t.Fatal(err)
+		}
+		file, err := os.Open(path)
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		for _, n := range []int{0, 1, 2, 3, 700, 5000} {
+			start, err := tailOffset(file, int64(len(tt.data)), n)
+			if err != nil {
+				t.Fatalf("%s, %d lines: %v", tt.name, n, err)
+			}
+			if got, want := tt.data[start:], naiveTail(tt.data, n); got != want {
+				t.Errorf("%s, %d lines: got %d bytes, want %d", tt.name, n, len(got), len(want))
+			}
+
+			rng := readRange{length: -1, lastBytes: -1, lastLines: n}
+			tail, err := rng.readTail(strings.NewReader(tt.data))
+			if err != nil {
+				t.Fatalf("%s, %d lines read forward: %v", tt.name, n, err)
+			}
+			if got, want := string(tail), naiveTail(tt.data, n); got != want {
+				t.Errorf("%s, %d lines read forward: got %d bytes, want %d", tt.name, n, len(got), len(want))
+			}
+		}
+		file.Close()
+	}
+}
+
+func TestReadTailBytes(t *testing.T) {
+	data := strings.Repeat("0123456789", tailBlock/2)
+	for _, n := range []int64{0, 1, 50, tailBlock, 3 * tailBlock, int64(len(data)), int64(len(data)) + 1} {
+		rng := readRange{length: -1, lastBytes: n, lastLines: -1}
+		tail, err := rng.readTail(strings.NewReader(data))
+		if err != nil {
+			t.Fatal(err)
+		}
+		want := data
+		if n < int64(len(data)) {
+			want = data[int64(len(data))-n:]
+		}
+		if string(tail) != want {
+			t.Errorf("last %d bytes: got %d bytes, want %d", n, len(tail), len(want))
+		}
+	}
+}
+
+// files in /proc report a size of 0, their tails must be read forward
+func TestReadFileTailOfPseudoFile(t *testing.T) {
+	const path = "/proc/meminfo"
+	if _, err := os.Stat(path); err != nil {
+		t.Skip("no", path)
+	}
+
+	ctx := context.Background()
+	tests := []struct {
+		args  []string
+		check func(string) bool
+	}{
+		{[]string{path, "last_lines=3"}, func(s string) bool { return strings.Count(s, "\n") == 3 }},
+		{[]string{path, "last_bytes=50"}, func(s string) bool { return len(s) == 50 }},
+	}
+	for _, tt := range tests {
+		got, err := readFile(ctx, tt.args)
+		if err != nil || !tt.check(got) {
+			t.Errorf("ReadFile %v = %q, %v", tt.args, got, err)
+		}
+	}
+
+	got, err := tailFile(ctx, []string{path, "3"})
+	if err != nil || strings.Count(got, "\n") != 3 {
+		t.Errorf("Tail %s 3 = %q, %v", path, got, err)
+	}
+}
@@ -0,0 +1,274 @@
+package base
+
+import (
+	"bufio"
+	"bytes"
+	"context"
+	"crypto/rand"
+	"encoding/hex"
+	"fmt"
+	"io"
+	"os"
+	"os/exec"
+	"strconv"
+	"sync"
+)
+
+// a shell pool keeps long-lived bash workers around so CommandExec does not pay for
+// fork+exec and bash startup on every command
+//
+// protocol, per command: the command text followed by a NUL byte goes to the worker's stdin,
+// the worker runs it in a subshell which prints "<token> pid <pid>\n" and then the combined
+// output of the command, and the worker follows it with "\n<token> <exit status> <leftovers>\n";
+// the token is random per worker so output can't fake it
+// the token is the first NUL-terminated string on stdin and stays an unexported shell variable,
+// both it and the command are unset in the subshell before the command runs, so neither is
+// visible to it
+// running every command in a subshell means cd, variables, traps and options never leak
+// from one command into the next
+// with job control on, every subshell is a process group of its own, the pid it reports;
+// leftovers is 1 when that group still has members after the subshell ended, background jobs
+// of the command that keep the worker's output open; the worker is replaced then, or their
+// output would end up in the next command's
+
+const workerScript = `set -m
+IFS= read -r -d '' __opsmith_token || exit 1
+while IFS= read -r -d '' __opsmith_cmd; do
+( printf '%s pid %d\n' "$__opsmith_token" "$BASHPID"; unset __opsmith_token; eval "unset __opsmith_cmd
+$__opsmith_cmd" ) </dev/null 2>&1 &
+__opsmith_pid=$!
+wait "$__opsmith_pid"
+__opsmith_status=$?
+__opsmith_leftovers=0
+kill -0 -- "-$__opsmith_pid" 2>/dev/null && __opsmith_leftovers=1
+printf '\n%s %d %d\n' "$__opsmith_token" "$__opsmith_status" "$__opsmith_leftovers"
+done`
+
+// shellWorker is one long-lived bash process
+type shellWorker struct {
+	cmd    *exec.Cmd
+	stdin  io.WriteCloser
+	stdout *bufio.Reader
+	token  []byte
+
+	mu     sync.Mutex
+	group  int  // process group of the running command, 0 between commands
+	killed bool // kill was called, a command reporting its group later is killed right away
+}
+
+// ShellPool hands out shell workers to run commands
+type ShellPool struct {
+	workers chan *shellWorker
+}
+
+// shellPool is used by CommandExec when set, see UseShellPool
+var shellPool *ShellPool
+
+// UseShellPool makes CommandExec run its commands on pool, nil goes back to fork/exec per command
+func UseShellPool(pool *ShellPool) {
+	shellPool = pool
+}
+
+// NewShellPool starts size shell workers
+func NewShellPool(size int) (*ShellPool, error) {
+	if size < 1 {
+		return nil, fmt.Errorf("shell pool needs at least one worker")
+	}
+
+	pool := &ShellPool{workers: make(chan *shellWorker, size)}
+	for i := 0; i < size; i++ {
+		worker, err := startShellWorker()
+		if err != nil {
+			pool.Close()
+			return nil, err
+		}
+		pool.workers <- worker
+	}
+	return pool, nil
+}
+
+// startShellWorker spawns a bash process running the worker loop
+func startShellWorker() (*shellWorker, error) {
+	var raw [16]byte
+	if _, err := rand.Read(raw[:]); err != nil {
+		return nil, fmt.Errorf("could not create worker token: %w", err)
+	}
+	token := "__opsmith_done_" + hex.EncodeToString(raw[:])
+
+	cmd := exec.Command("/bin/bash", "-c", workerScript)
+	setProcessGroup(cmd)
+
+	stdin, err := cmd.StdinPipe()
+	if err != nil {
+		return nil, fmt.Errorf("could not create worker stdin: %w", err)
+	}
+	stdout, err := cmd.StdoutPipe()
+	if err != nil {
+		return nil, fmt.Errorf("could not create worker stdout: %w", err)
+	}
+
+	if err := cmd.Start(); err != nil {
+		return nil, fmt.Errorf("could not start shell worker: %w", err)
+	}
+	if _, err := io.WriteString(stdin, token+"\x00"); err != nil {
+		cmd.Process.Kill()
+		cmd.Wait()
+		return nil, fmt.Errorf("could not send worker token: %w", err)
+	}
+
+	return &shellWorker{
+		cmd:    cmd,
+		stdin:  stdin,
+		stdout: bufio.NewReaderSize(stdout, 64<<10),
+		token:  []byte(token + " "),
+	}, nil
+}
+
+// run executes one command on the worker and returns its combined output and exit status,
+// and whether processes it started outlived it
+func (w *shellWorker) run(command string) ([]byte, int, bool, error) {
+	if _, err := io.WriteString(w.stdin, command+"\x00"); err != nil {
+		return nil, 0, false, fmt.Errorf("could not send command to shell worker: %w", err)
+	}
+	defer w.setGroup(0)
+
+	var out bytes.Buffer
+	started := false
+	for {
+		line, err := w.stdout.ReadBytes('\n')
+		if err != nil {
+			return nil, 0, false, fmt.Errorf("shell worker died: %w", err)
+		}
+
+		// the subshell reports its process group before the command writes anything
+		if !started {
+			rest, ok := bytes.CutPrefix(line, w.token)
+			pid, err := strconv.Atoi(string(bytes.TrimSpace(bytes.TrimPrefix(rest, []byte("pid ")))))
+			if !ok || err != nil {
+				return nil, 0, false, fmt.Errorf("malformed start from shell worker: %q", line)
+			}
+			w.setGroup(pid)
+			started = true
+			continue
+		}
+
+		// the terminator always follows the newline the worker adds after the output
+		if bytes.HasPrefix(line, w.token) && (out.Len() == 0 || out.Bytes()[out.Len()-1] == '\n') {
+			var status, leftovers int
+			if _, err := fmt.Sscanf(string(line[len(w.token):]), "%d %d", &status, &leftovers); err != nil {
+				return nil, 0, false, fmt.Errorf("malformed status from shell worker: %q", line)
+			}
+			output := out.Bytes()
+			if len(output) > 0 {
+				output = output[:len(output)-1]
+			}
+			return output, status, leftovers != 0, nil
+		}
+		out.Write(line)
+	}
+}
+
+// setGroup records the process group of the running command
+func (w *shellWorker) setGroup(pid int) {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+	w.group = pid
+	if pid != 0 && w.killed {
+		killGroup(pid)
+	}
+}
+
+// kill kills the worker and the command it runs, with everything the command started
+func (w *shellWorker) kill() {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+	w.killed = true
+	killProcessGroup(w.cmd.Process)
+	if w.group != 0 {
+		killGroup(w.group)
+	}
+}
+
+// killGroup kills the process group led by pid
+func killGroup(pid int) {
+	if p, err := os.FindProcess(pid); err == nil {
+		killProcessGroup(p)
+	}
+}
+
+// close stops the worker and whatever it is still running
+func (w *shellWorker) close() {
+	w.stdin.Close()
+	w.kill()
+	w.cmd.Wait()
+}
+
+// Exec runs command on a free worker, waiting for one if all are busy
+// when ctx ends while the command runs, the worker is killed with the command
+// a worker that breaks is replaced so the pool keeps its size
+func (p *ShellPool) Exec(ctx context.Context, command string) ([]byte, int, error) {
+	var worker *shellWorker
+	select {
+	case worker = <-p.workers:
+	case <-ctx.Done():
+		return nil, 0, ctx.Err()
+	}
+
+	stop := context.AfterFunc(ctx, worker.kill)
+	out, status, leftovers, err := worker.run(command)
+	if !stop() {
+		// killed, even if the command made it to the end the worker is gone
+		if err != nil {
+			err = ctx.Err()
+		}
+		worker.close()
+		if replacement, serr := startShellWorker(); serr == nil {
+			worker = replacement
+		}
+	} else if err != nil || leftovers {
+		// e.g. the command killed its own shell, or left background jobs writing to the worker;
+		// a dead worker goes back into the pool when no replacement starts, its next command
+		// fails fast and tries again
+		worker.close()
+		if replacement, serr := startShellWorker(); serr == nil {
+			worker = replacement
+		}
+	}
+
+	p.workers <- worker
+	return out, status, err
+}
+
+// pooledCommandExec is CommandExec on a shell pool, with the same results as fork/exec
+func pooledCommandExec(ctx context.Context, pool *ShellPool, args []string) (string, error) {
+	command, err := commandArg(args)
+	if err != nil {
+		return "", err
+	}
+
+	out, status, err := pool.Exec(ctx, command)
+	if err != nil {
+		return "", fmt.Errorf("could not execute command %s: %w", command, err)
+	}
+	if status != 0 {
+		return "", fmt.Errorf("could not execute command %s: exit status %d", command, status)
+	}
+
+	if len(out) == 0 {
+		return "", fmt.Errorf("command %s returned no output", command)
+	}
+
+	return string(out), nil
+}
+
+// Close stops all idle workers
+func (p *ShellPool) Close() {
+	for {
+		select {
+		case worker := <-p.workers:
+			worker.close()
+		default:
+			return
+		}
+	}
+}
@@ -0,0 +1,146 @@
+package base
+
+import (
+	"context"
+	"fmt"
+	"io"
+)
+
+// streamFunc defines the signature for primitives that write their output incrementally
+type streamFunc func(ctx context.Context, args []string, w io.Writer) error
+
+// streamRegistry holds primitives that can stream their output instead of buffering it
+// primitives missing here fall back to their buffered version in stream mode
+var streamRegistry = map[string]streamFunc{
+	"ReadFile":    streamReadFile,
+	"CommandExec": streamCommandExec,
+	"WalkTree":    streamWalkTree,
+}
+
+// RegisterStreamPrimitive adds a streaming variant of a primitive
+func RegisterStreamPrimitive(name string, fn streamFunc) {
+	streamRegistry[name] = fn
+}
+
+// streamSegment is how much of a file is streamed between cancellation checks
+const streamSegment = 16 << 20
+
+// StreamSink returns the writer that receives the streamed output of command i
+type StreamSink func(i int) io.Writer
+
+// countingWriter tracks how many bytes went through it
+type countingWriter struct {
+	w io.Writer
+	n int64
+}
+
+func (cw *countingWriter) Write(p []byte) (int, error) {
+	n, err := cw.w.Write(p)
+	cw.n += int64(n)
+	return n, err
+}
+
+// streamReadFile copies the file to w without holding it in memory, tails found by readPseudoTail aside
+func streamReadFile(ctx context.Context, args []string, w io.Writer) error {
+	if tail, ok, err := readPseudoTail(ctx, args); ok {
+		if err != nil {
+			return err
+		}
+		_, err = w.Write(tail)
+		return err
+	}
+
+	file, filepath, n, err := openRange(args)
+	if err != nil {
+		return err
+	}
+	defer file.Close()
+
+	// copy in segments to notice cancellation, each segment still goes out by sendfile in raw mode
+	for remaining := n; remaining != 0; {
+		if err := ctx.Err(); err != nil {
+			return err
+		}
+
+		segment := int64(streamSegment)
+		if remaining > 0 && remaining < segment {
+			segment = remaining
+		}
+		copied, err := io.CopyN(w, file, segment)
+		if remaining > 0 {
+			remaining -= copied
+		}
+		if err == io.EOF {
+			return nil
+		}
+		if err != nil {
+			return fmt.Errorf("could not stream file %s: %w", filepath, err)
+		}
+	}
+
+	return nil
+}
+
+// streamCommandExec forwards combined stdout and stderr to w while the command runs
+func streamCommandExec(ctx context.Context, args []string, w io.Writer) error {
+	cmd, command, err := shellCommand(ctx, args)
+	if err != nil {
+		return err
+	}
+
+	release, err := acquireExec(ctx)
+	if err != nil {
+		return err
+	}
+	defer release()
+
+	// same writer for both, so exec serializes the writes
+	out := &countingWriter{w: w}
+	cmd.Stdout = out
+	cmd.Stderr = out
+
+	if err := cmd.Run(); err != nil && !detachedOutput(err) {
+		return fmt.Errorf("could not execute command %s: %w", command, err)
+	}
+
+	if out.n == 0 {
+		return fmt.Errorf("command %s returned no output", command)
+	}
+
+	return nil
+}
+
+// RunStream executes the command, streaming its output to w when the primitive supports it
+// streamed output is not repeated in the returned response's Data
+func (c *Command) RunStream(ctx context.Context, w io.Writer) Response {
+	fn, exists := streamRegistry[c.Name]
+	if !exists {
+		return c.Run(ctx)
+	}
+	if err := ctx.Err(); err != nil {
+		return Response{"", fmt.Sprintf("command %s not run: %v", c.Name, err), StatusError}
+	}
+
+	ctx, cancel := c.context(ctx)
+	defer cancel()
+
+	if err := fn(ctx, c.Args, w); err != nil {
+		return c.failed(ctx, err)
+	}
+
+	return Response{"", "", StatusOK}
+}
+
+// RunBatchStream executes the batch in sequence, streaming output of command i to sink(i)
+func (b *Batch) RunBatchStream(ctx context.Context, sink StreamSink) BatchResponse {
+	return b.run(b.coalesceAppends(func(i int) Response {
+		return b.Commands[i].RunStream(ctx, sink(i))
+	}))
+}
+
+// RunBatchParallelStream is RunBatchParallel with streamed output
+func (b *Batch) RunBatchParallelStream(ctx context.Context, workers int, sink StreamSink) BatchResponse {
+	return b.runParallel(workers, b.coalesceAppends(func(i int) Response {
+		return b.Commands[i].RunStream(ctx, sink(i))
+	}))
+}
@@ -0,0 +1,203 @@
+package base
+
+import (
+	"context"
+	"errors"
+	"io"
+	"io/fs"
+	"os"
+	"path/filepath"
+	"sync"
+	"sync/atomic"
+)
+
+// walkParallel is a work-stealing directory walker
+// every worker keeps a stack of directories it found and reads them depth first, a worker
+// that runs dry steals the older half of another worker's stack, so big subtrees get shared
+// out while small ones stay on the worker that found them
+// directories are read walkBatch entries per getdents call and subdirectories are pushed
+// as they are seen, huge directories become stealable work before they are fully read
+
+// walkBatch is how many directory entries are read per call
+const walkBatch = 256
+
+// errStopWalk returned by a visit function ends the walk without an error
+var errStopWalk = errors.New("stop walk")
+
+// walkQueue is the directory stack of one worker
+type walkQueue struct {
+	mu   sync.Mutex
+	dirs []string
+}
+
+func (q *walkQueue) push(dir string) {
+	q.mu.Lock()
+	q.dirs = append(q.dirs, dir)
+	q.mu.Unlock()
+}
+
+// pop takes the most recently found directory
+func (q *walkQueue) pop() (string, bool) {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	if len(q.dirs) == 0 {
+		return "", false
+	}
+	dir := q.dirs[len(q.dirs)-1]
+	q.dirs = q.dirs[:len(q.dirs)-1]
+	return dir, true
+}
+
+// steal takes the older half of the stack, those are closest to the root and hold the most work
+func (q *walkQueue) steal() []string {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	n := (len(q.dirs) + 1) / 2
+	if n == 0 {
+		return nil
+	}
+	stolen := append([]string(nil), q.dirs[:n]...)
+	q.dirs = append(q.dirs[:0], q.dirs[n:]...)
+	return stolen
+}
+
+// treeWalk is the state shared by the workers of one walk
+type treeWalk struct {
+	ctx     context.Context
+	root    string
+	visit   func(worker int, dir string, entry fs.DirEntry) error
+	queues  []walkQueue
+	pending atomic.Int64  // directories queued or being read
+	wake    chan struct{} // signals idle workers that work was pushed
+	done    chan struct{} // closed when pending drops to zero
+
+	failed atomic.Bool
+	once   sync.Once
+	err    error
+}
+
+// walkParallel calls visit for every entry below root on up to workers goroutines until ctx
+// ends, symlinks are not followed and unreadable subdirectories are skipped like du and find do
+// visit is called concurrently with the index of the calling worker, so callers can keep
+// per-worker state without locking; it stops the walk by returning an error
+func walkParallel(ctx context.Context, root string, workers int, visit func(worker int, dir string, entry fs.DirEntry) error) error {
+	if workers < 1 {
+		workers = 1
+	}
+
+	w := &treeWalk{
+		ctx:    ctx,
+		root:   root,
+		visit:  visit,
+		queues: make([]walkQueue, workers),
+		wake:   make(chan struct{}, workers),
+		done:   make(chan struct{}),
+	}
+	w.pending.Store(1)
+	w.queues[0].push(root)
+
+	var wg sync.WaitGroup
+	for i := 0; i < workers; i++ {
+		wg.Add(1)
+		go func(id int) {
+			defer wg.Done()
+			w.work(id)
+		}(i)
+	}
+	wg.Wait()
+
+	if errors.Is(w.err, errStopWalk) {
+		return nil
+	}
+	return w.err
+}
+
+// work runs one worker until the whole tree is read
+func (w *treeWalk) work(id int) {
+	for {
+		dir, ok := w.next(id)
+		if !ok {
+			select {
+			case <-w.wake:
+				continue
+			case <-w.done:
+				return
+			}
+		}
+
+		if !w.failed.Load() {
+			w.readDir(id, dir)
+		}
+		if w.pending.Add(-1) == 0 {
+			close(w.done)
+		}
+	}
+}
+
+// next returns a directory from the worker's own stack, stealing from the others when it is empty
+func (w *treeWalk) next(id int) (string, bool) {
+	if dir, ok := w.queues[id].pop(); ok {
+		return dir, true
+	}
+
+	for i := 1; i < len(w.queues); i++ {
+		victim := (id + i) % len(w.queues)
+		stolen := w.queues[victim].steal()
+		if len(stolen) == 0 {
+			continue
+		}
+		for _, dir := range stolen[1:] {
+			w.queues[id].push(dir)
+		}
+		return stolen[0], true
+	}
+	return "", false
+}
+
+// readDir visits the entries of dir and queues its subdirectories
+func (w *treeWalk) readDir(id int, dir string) {
+	if err := w.ctx.Err(); err != nil {
+		w.fail(err)
+		return
+	}
+
+	f, err := os.Open(dir)
+	if err != nil {
+		if dir == w.root {
+			w.fail(err)
+		}
+		return
+	}
+	defer f.Close()
+
+	for {
+		entries, err := f.ReadDir(walkBatch)
+		for _, entry := range entries {
+			if verr := w.visit(id, dir, entry); verr != nil {
+				w.fail(verr)
+				return
+			}
+			if entry.IsDir() {
+				w.pending.Add(1)
+				w.queues[id].push(filepath.Join(dir, entry.Name()))
+				select {
+				case w.wake <- struct{}{}:
+				default:
+				}
+			}
+		}
+
+		if err != nil {
+			if err != io.EOF && dir == w.root {
+				w.fail(err)
+			}
+			return
+		}
+	}
+}
+
+// fail records the first error and makes the remaining workers drain their queues
+func (w *treeWalk) fail(err error) {
+	w.once.Do(func() { w.err = err })
+	w.failed.Store(true)
+}
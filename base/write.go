@@ -0,0 +1,253 @@
+package base
+
+import (
+	"fmt"
+	"os"
+	"path/filepath"
+	"runtime"
+)
+
+// write policy of WriteFile and AppendFile, set once by the slave at start up
+//
+// fsync none leaves durability to the kernel, data flushes file contents (fdatasync on linux),
+// full flushes contents and metadata and, for renames, the directory entry
+// with atomic writes WriteFile writes a temporary file next to the target and renames it over
+// the target, readers see the old or the new contents and never a mix; the new contents
+// replace the file entirely instead of overwriting its start
+//
+// adjacent AppendFile commands of a batch to the same file are coalesced into one open and
+// one vectored write
+
+// FsyncPolicy says how far written data is flushed before a write primitive returns
+type FsyncPolicy int
+
+const (
+	FsyncNone FsyncPolicy = iota
+	FsyncData
+	FsyncFull
+)
+
+// ParseFsyncPolicy parses none, data or full
+func ParseFsyncPolicy(s string) (FsyncPolicy, error) {
+	switch s {
+	case "none":
+		return FsyncNone, nil
+	case "data":
+		return FsyncData, nil
+	case "full":
+		return FsyncFull, nil
+	}
+	return FsyncNone, fmt.Errorf("unknown fsync policy %s, expected none, data or full", s)
+}
+
+var writePolicy struct {
+	fsync  FsyncPolicy
+	atomic bool
+}
+
+// SetWritePolicy configures durability and atomicity of the write primitives
+func SetWritePolicy(fsync FsyncPolicy, atomic bool) {
+	writePolicy.fsync = fsync
+	writePolicy.atomic = atomic
+}
+
+// syncFile flushes file according to the fsync policy
+func syncFile(file *os.File) error {
+	switch writePolicy.fsync {
+	case FsyncData:
+		return syncData(file)
+	case FsyncFull:
+		return file.Sync()
+	}
+	return nil
+}
+
+// appendTo appends contents to the existing file at path with a single vectored write
+func appendTo(path string, contents [][]byte) error {
+	file, err := os.OpenFile(path, os.O_APPEND|os.O_WRONLY, 0644) // wont create file it it doesn't exist (still takes the third argument)
+	if err != nil {
+		return fmt.Errorf("could not open file %s: %w", path, err)
+	}
+	defer file.Close()
+
+	if err := writev(file, contents); err != nil {
+		return fmt.Errorf("could not append to file %s: %w", path, err)
+	}
+
+	if err := syncFile(file); err != nil {
+		return fmt.Errorf("could not sync file %s: %w", path, err)
+	}
+	return nil
+}
+
+// replaceFile atomically replaces the contents of the existing file at path
+// a symlink is resolved first so the link stays and its target is replaced; the file keeps its
+// permissions and owner, the temporary file is removed on failure
+// files with other hard links, and files whose owner can't be kept, are rewritten in place
+// instead, a rename would split them from their other names or hand them to the slave's user
+func replaceFile(path, content string) error {
+	target, err := filepath.EvalSymlinks(path)
+	if err != nil {
+		return fmt.Errorf("could not open file %s: %w", path, err)
+	}
+	info, err := os.Stat(target)
+	if err != nil {
+		return fmt.Errorf("could not open file %s: %w", path, err)
+	}
+	uid, gid, links, ok := fileOwner(info)
+	if ok && links > 1 {
+		return overwriteFile(target, content)
+	}
+
+	dir := filepath.Dir(target)
+	tmp, err := os.CreateTemp(dir, "."+filepath.Base(target)+".tmp-*")
+	if err != nil {
+		return fmt.Errorf("could not create temporary file for %s: %w", path, err)
+	}
+	defer func() {
+		if tmp != nil {
+			tmp.Close()
+			os.Remove(tmp.Name())
+		}
+	}()
+
+	if ok {
+		if err := tmp.Chown(uid, gid); err != nil {
+			return overwriteFile(target, content)
+		}
+	}
+	if _, err := tmp.WriteString(content); err != nil {
+		return fmt.Errorf("could not write to file %s: %w", path, err)
+	}
+	if err := tmp.Chmod(info.Mode().Perm()); err != nil && runtime.GOOS != "windows" {
+		return fmt.Errorf("could not set permissions of %s: %w", path, err)
+	}
+	if err := syncFile(tmp); err != nil {
+		return fmt.Errorf("could not sync file %s: %w", path, err)
+	}
+	if err := tmp.Close(); err != nil {
+		return fmt.Errorf("could not write to file %s: %w", path, err)
+	}
+
+	if err := os.Rename(tmp.Name(), target); err != nil {
+		return fmt.Errorf("could not replace file %s: %w", path, err)
+	}
+	tmp = nil
+
+	if writePolicy.fsync == FsyncFull {
+		if err := syncDir(dir); err != nil {
+			return fmt.Errorf("could not sync directory %s: %w", dir, err)
+		}
+	}
+	return nil
+}
+
+// overwriteFile replaces the contents of the existing file at path in place, it is not atomic
+func overwriteFile(path, content string) error {
+	file, err := os.OpenFile(path, os.O_WRONLY|os.O_TRUNC, 0644)
+	if err != nil {
+		return fmt.Errorf("could not open file %s: %w", path, err)
+	}
+	defer file.Close()
+
+	if _, err := file.WriteString(content); err != nil {
+		return fmt.Errorf("could not write to file %s: %w", path, err)
+	}
+	if err := syncFile(file); err != nil {
+		return fmt.Errorf("could not sync file %s: %w", path, err)
+	}
+	if err := file.Close(); err != nil {
+		return fmt.Errorf("could not write to file %s: %w", path, err)
+	}
+	return nil
+}
+
+// appendGroups finds runs of adjacent AppendFile commands to the same file
+// it returns, for every command, the index of the last command of the run it starts, or -1
+// members of a run must not carry their own depends_on, in parallel batches they are then
+// ordered after the first command of the run by the path conflict
+func (b *Batch) appendGroups() ([]int, bool) {
+	ends := make([]int, len(b.Commands))
+	found := false
+
+	for i := 0; i < len(b.Commands); {
+		ends[i] = -1
+		path, ok := appendPath(&b.Commands[i])
+		if !ok {
+			i++
+			continue
+		}
+
+		j := i + 1
+		for j < len(b.Commands) && b.Commands[j].DependsOn == nil {
+			next, ok := appendPath(&b.Commands[j])
+			if !ok || next != path {
+				break
+			}
+			ends[j] = -1
+			j++
+		}
+
+		if j-i > 1 {
+			ends[i] = j - 1
+			found = true
+		}
+		i = j
+	}
+
+	return ends, found
+}
+
+// appendPath returns the expanded target of a valid AppendFile command
+func appendPath(c *Command) (string, bool) {
+	if c.Name != "AppendFile" || len(c.Args) != 2 {
+		return "", false
+	}
+	path, err := primitivePath(c.Args[0])
+	if err != nil {
+		return "", false
+	}
+	return filepath.Clean(path), true
+}
+
+// coalesceAppends wraps run so every run of appends to the same file is executed by its first
+// command as one write, the other commands of the run return the result recorded for them
+func (b *Batch) coalesceAppends(run func(i int) Response) func(i int) Response {
+	ends, found := b.appendGroups()
+	if !found {
+		return run
+	}
+
+	results := make([]Response, len(b.Commands))
+	inGroup := make([]bool, len(b.Commands))
+	for i, end := range ends {
+		for j := i + 1; j <= end; j++ {
+			inGroup[j] = true
+		}
+	}
+
+	return func(i int) Response {
+		if inGroup[i] {
+			return results[i]
+		}
+		end := ends[i]
+		if end < 0 {
+			return run(i)
+		}
+
+		path, _ := appendPath(&b.Commands[i])
+		contents := make([][]byte, 0, end-i+1)
+		for j := i; j <= end; j++ {
+			contents = append(contents, []byte(b.Commands[j].Args[1]))
+		}
+
+		resp := Response{"Appended Successfully", "", StatusOK}
+		if err := appendTo(path, contents); err != nil {
+			resp = Response{"", fmt.Sprintf("error running primitive AppendFile: %v", err), StatusError}
+		}
+		for j := i; j <= end; j++ {
+			results[j] = resp
+		}
+		return resp
+	}
+}
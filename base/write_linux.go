@@ -0,0 +1,87 @@
+package base
+
+import (
+	"os"
+	"syscall"
+	"unsafe"
+)
+
+// maxIovecs is the most buffers a single writev call takes (IOV_MAX)
+const maxIovecs = 1024
+
+// writev writes all buffers to file with as few writev calls as possible
+func writev(file *os.File, bufs [][]byte) error {
+	rc, err := file.SyscallConn()
+	if err != nil {
+		return err
+	}
+
+	iovecs := make([]syscall.Iovec, 0, len(bufs))
+	for _, buf := range bufs {
+		if len(buf) > 0 {
+			iovec := syscall.Iovec{Base: &buf[0]}
+			iovec.SetLen(len(buf))
+			iovecs = append(iovecs, iovec)
+		}
+	}
+
+	for len(iovecs) > 0 {
+		batch := iovecs
+		if len(batch) > maxIovecs {
+			batch = batch[:maxIovecs]
+		}
+
+		var n uintptr
+		var errno syscall.Errno
+		err := rc.Write(func(fd uintptr) bool {
+			n, _, errno = syscall.Syscall(syscall.SYS_WRITEV, fd, uintptr(unsafe.Pointer(&batch[0])), uintptr(len(batch)))
+			return errno != syscall.EAGAIN
+		})
+		if err != nil {
+			return err
+		}
+		if errno == syscall.EINTR {
+			continue
+		}
+		if errno != 0 {
+			return errno
+		}
+
+		// drop what was written, a short write leaves part of an iovec
+		written := uint64(n)
+		for len(iovecs) > 0 && written >= uint64(iovecs[0].Len) {
+			written -= uint64(iovecs[0].Len)
+			iovecs = iovecs[1:]
+		}
+		if written > 0 {
+			iovecs[0].Base = (*byte)(unsafe.Add(unsafe.Pointer(iovecs[0].Base), written))
+			iovecs[0].SetLen(int(uint64(iovecs[0].Len) - written))
+		}
+	}
+
+	return nil
+}
+
+// syncData flushes file contents and only the metadata needed to read them back
+func syncData(file *os.File) error {
+	return syscall.Fdatasync(int(file.Fd()))
+}
+
+// syncDir flushes the entries of dir, making renames and creations in it durable
+func syncDir(dir string) error {
+	d, err := os.Open(dir)
+	if err != nil {
+		return err
+	}
+	defer d.Close()
+	return d.Sync()
+}
+
+// fileOwner returns owner, group and hard link count of a file
+func fileOwner(info os.FileInfo) (uid, gid int, links uint64, ok bool) {
+	st, ok := info.Sys().(*syscall.Stat_t)
+	if !ok {
+		return 0, 0, 0, false
+	}
+	return int(st.Uid), int(st.Gid), uint64(st.Nlink), true
+}
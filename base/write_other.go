@@ -0,0 +1,30 @@
+//go:build !linux
+
+package base
+
+import "os"
+
+// writev writes all buffers to file, one write per buffer
+func writev(file *os.File, bufs [][]byte) error {
+	for _, buf := range bufs {
+		if _, err := file.Write(buf); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// syncData has no cheaper variant here, it flushes everything
+func syncData(file *os.File) error {
+	return file.Sync()
+}
+
+// syncDir is a no-op, directories can't be flushed on their own here
+func syncDir(dir string) error {
+	return nil
+}
+
+// fileOwner has no owner or link count to offer here
+func fileOwner(info os.FileInfo) (uid, gid int, links uint64, ok bool) {
+	return 0, 0, 0, false
+}
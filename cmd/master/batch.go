@@ -0,0 +1,119 @@
+package main
+
+import (
+	"bufio"
+	"context"
+	"encoding/json"
+	"fmt"
+	"os"
+	"strings"
+	"sync"
+
+	basepkg "github.com/neofytr/opSmith/base"
+)
+
+// batchRecord is one NDJSON output line of batch mode
+type batchRecord struct {
+	Index   int                `json:"index"`
+	Prompt  string             `json:"prompt"`
+	Status  int                `json:"status"`
+	Error   string             `json:"error,omitempty"`
+	Results []basepkg.Response `json:"results,omitempty"`
+}
+
+// readPrompts reads one request per line from path, blank lines and # comments are skipped
+func readPrompts(path string) ([]string, error) {
+	file, err := os.Open(path)
+	if err != nil {
+		return nil, fmt.Errorf("could not open file %s: %w", path, err)
+	}
+	defer file.Close()
+
+	var prompts []string
+	scanner := bufio.NewScanner(file)
+	scanner.Buffer(make([]byte, 64<<10), 1<<20)
+	for scanner.Scan() {
+		line := strings.TrimSpace(scanner.Text())
+		if line == "" || strings.HasPrefix(line, "#") {
+			continue
+		}
+		prompts = append(prompts, line)
+	}
+	if err := scanner.Err(); err != nil {
+		return nil, fmt.Errorf("could not read file %s: %w", path, err)
+	}
+
+	if len(prompts) == 0 {
+		return nil, fmt.Errorf("file %s contains no requests", path)
+	}
+	return prompts, nil
+}
+
+// runPromptBatch handles every prompt as a separate request
+// at most cfg.llmConcurrency plans are generated at once, each plan goes to the slave over the
+// shared connection as soon as it is ready and its result is printed as one NDJSON line
+// cfg.timeout applies to every generation on its own, cfg.execTimeout to every plan the slave runs
+func runPromptBatch(ctx context.Context, cfg *config, llm *basepkg.LLMClient, cache *basepkg.PlanCache, client *basepkg.SlaveClient, prompts []string) error {
+	var flags byte
+	if cfg.parallel {
+		flags |= basepkg.FlagParallel
+	}
+
+	sem := make(chan struct{}, cfg.llmConcurrency)
+	encoder := json.NewEncoder(cfg.out)
+
+	var mu sync.Mutex // guards encoder and failed
+	failed := 0
+	emit := func(record batchRecord) {
+		mu.Lock()
+		defer mu.Unlock()
+		if record.Status != basepkg.StatusOK {
+			failed++
+		}
+		encoder.Encode(record)
+	}
+
+	var wg sync.WaitGroup
+	for i, prompt := range prompts {
+		wg.Add(1)
+		go func(i int, prompt string) {
+			defer wg.Done()
+			record := batchRecord{Index: i, Prompt: prompt, Status: basepkg.StatusError}
+
+			plan, cached := cachedPlan(cache, prompt)
+			if !cached {
+				sem <- struct{}{}
+				genCtx, cancel := context.WithTimeout(ctx, cfg.timeout)
+				var err error
+				plan, err = generateCommands(genCtx, llm, prompt, cache)
+				cancel()
+				<-sem
+				if err != nil {
+					record.Error = fmt.Sprintf("failed to generate commands: %v", err)
+					emit(record)
+					return
+				}
+			}
+
+			execCtx, cancelExec := withExecTimeout(ctx, cfg)
+			resp, err := client.Do(execCtx, []byte(plan), flags)
+			cancelExec()
+			switch {
+			case err != nil:
+				record.Error = fmt.Sprintf("failed to get response from slave: %v", err)
+			case resp.Error != "":
+				record.Error = fmt.Sprintf("slave could not run batch: %s", resp.Error)
+			default:
+				record.Status = resp.Status
+				record.Results = resp.Results
+			}
+			emit(record)
+		}(i, prompt)
+	}
+	wg.Wait()
+
+	if failed > 0 {
+		return fmt.Errorf("%d of %d requests failed", failed, len(prompts))
+	}
+	return nil
+}
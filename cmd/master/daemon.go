@@ -0,0 +1,376 @@
+package main
+
+import (
+	"context"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io"
+	"net"
+	"os"
+	"os/signal"
+	"path/filepath"
+	"sync"
+	"sync/atomic"
+	"syscall"
+	"time"
+
+	basepkg "github.com/neofytr/opSmith/base"
+)
+
+// daemon mode keeps what makes a short run slow warm between runs: the LLM client and its
+// pooled connections, connections to the slaves, the plan cache and the coalescing of
+// identical model calls, which now also covers runs started by different invocations
+// a forwarded run sends its command line over a unix socket and prints what comes back
+//
+// the exchange reuses the slave framing: the client sends a FrameBatch carrying a daemonRequest,
+// the daemon answers with FrameChunk frames holding the run's output and one FrameBatchResponse
+// carrying a daemonReply; the client closing its connection cancels the run
+
+// daemonRequest is the payload of the request frame
+type daemonRequest struct {
+	Args  []string `json:"args,omitempty"`  // command line of the run without the program name
+	Stats bool     `json:"stats,omitempty"` // print the daemon's metrics instead of running
+}
+
+// daemonReply is the payload of the final frame of a run
+type daemonReply struct {
+	Error string `json:"error,omitempty"`
+}
+
+// pathFlags are the flags taking a local path, forwarded runs send them as absolute paths
+// since the daemon runs in a directory of its own
+var pathFlags = map[string]bool{
+	"--run-from-file": true,
+	"--raw-dir":       true,
+	"--inventory":     true,
+	"--batch-file":    true,
+	"--cache-dir":     true,
+}
+
+// defaultSocketPath is the daemon socket used when --socket is not given
+func defaultSocketPath() string {
+	dir := os.Getenv("XDG_RUNTIME_DIR")
+	if dir == "" {
+		dir = os.TempDir()
+	}
+	return filepath.Join(dir, fmt.Sprintf("opsmith-%d.sock", os.Getuid()))
+}
+
+// maxIdleSlaveConns is how many unused connections the daemon keeps per slave
+const maxIdleSlaveConns = 4
+
+// slavePool keeps connections to slaves for the lifetime of the daemon
+// every run gets a connection of its own: the slave runs the batches of a connection one after
+// another, runs sharing one would queue behind each other's commands on their exec timeout;
+// connections given back are kept for later runs, broken ones are dropped
+type slavePool struct {
+	mu     sync.Mutex
+	idle   map[string][]*basepkg.SlaveClient
+	inUse  int
+	closed bool
+}
+
+func newSlavePool() *slavePool {
+	return &slavePool{idle: make(map[string][]*basepkg.SlaveClient)}
+}
+
+// get returns an idle connection to addr, dialing one when there is none, and the function
+// that gives it back
+func (p *slavePool) get(addr string, timeout time.Duration) (*basepkg.SlaveClient, func(), error) {
+	p.mu.Lock()
+	var client *basepkg.SlaveClient
+	for client == nil && len(p.idle[addr]) > 0 {
+		idle := p.idle[addr]
+		client, p.idle[addr] = idle[len(idle)-1], idle[:len(idle)-1]
+		if client.Err() != nil {
+			client.Close()
+			client = nil
+		}
+	}
+	p.inUse++
+	p.mu.Unlock()
+
+	if client == nil {
+		var err error
+		if client, err = basepkg.DialSlave(addr, timeout); err != nil {
+			p.mu.Lock()
+			p.inUse--
+			p.mu.Unlock()
+			return nil, nil, err
+		}
+	}
+
+	release := func() {
+		p.mu.Lock()
+		defer p.mu.Unlock()
+		p.inUse--
+		if p.closed || client.Err() != nil || len(p.idle[addr]) >= maxIdleSlaveConns {
+			client.Close()
+			return
+		}
+		p.idle[addr] = append(p.idle[addr], client)
+	}
+	return client, release, nil
+}
+
+// size returns how many slave connections are open, in use or idle
+func (p *slavePool) size() int {
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	n := p.inUse
+	for _, clients := range p.idle {
+		for _, client := range clients {
+			if client.Err() == nil {
+				n++
+			}
+		}
+	}
+	return n
+}
+
+// close closes the idle connections, the ones in use are closed when given back
+func (p *slavePool) close() {
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	p.closed = true
+	for addr, clients := range p.idle {
+		for _, client := range clients {
+			client.Close()
+		}
+		delete(p.idle, addr)
+	}
+}
+
+// daemon serves forwarded runs with one shared session
+type daemon struct {
+	session *session
+	started time.Time
+
+	runs   atomic.Uint64
+	failed atomic.Uint64
+	active atomic.Int64
+	busy   atomic.Int64 // nanoseconds spent in finished runs
+}
+
+// runDaemon listens on cfg.socket until interrupted
+// the plan cache and model settings of cfg are the daemon's, forwarded runs can only turn the cache off
+func runDaemon(cfg *config) error {
+	// a socket nobody answers on is left over from a daemon that died, replace it
+	if conn, err := net.Dial("unix", cfg.socket); err == nil {
+		conn.Close()
+		return fmt.Errorf("a daemon is already listening on %s", cfg.socket)
+	}
+	if err := os.Remove(cfg.socket); err != nil && !errors.Is(err, os.ErrNotExist) {
+		return fmt.Errorf("could not remove stale socket %s: %w", cfg.socket, err)
+	}
+
+	ln, err := net.Listen("unix", cfg.socket)
+	if err != nil {
+		return fmt.Errorf("could not listen on %s: %w", cfg.socket, err)
+	}
+	defer ln.Close()
+
+	// runs execute commands on slaves, only the owner may ask for them
+	if err := os.Chmod(cfg.socket, 0600); err != nil {
+		return fmt.Errorf("could not restrict socket %s: %w", cfg.socket, err)
+	}
+
+	d := &daemon{session: newSession(cfg), started: time.Now()}
+	d.session.slaves = newSlavePool()
+	defer d.session.slaves.close()
+
+	// both models are loaded up front, keep-alive keeps them loaded between runs
+	d.session.preload(context.Background(), []basepkg.Model{generateModel, formatModel}, func(model basepkg.Model, took time.Duration, err error) {
+		if err != nil {
+			fmt.Printf("warning: %v\n", err)
+			return
+		}
+		fmt.Printf("preloaded %s in %s\n", model, took.Round(time.Millisecond))
+	})
+
+	sigChan := make(chan os.Signal, 1)
+	signal.Notify(sigChan, os.Interrupt, syscall.SIGTERM)
+	go func() {
+		<-sigChan
+		fmt.Println("\nreceived interrupt signal, shutting down...")
+		ln.Close()
+	}()
+
+	fmt.Printf("daemon listening on %s\n", cfg.socket)
+
+	for {
+		conn, err := ln.Accept()
+		if err != nil {
+			if errors.Is(err, net.ErrClosed) {
+				return nil
+			}
+			return fmt.Errorf("could not accept connection: %w", err)
+		}
+		go d.serve(conn)
+	}
+}
+
+// serve handles the request of one client connection
+func (d *daemon) serve(conn net.Conn) {
+	fc := basepkg.NewFrameConn(conn)
+	defer fc.Close()
+
+	f, err := fc.ReadFrame()
+	if err != nil || f.Type != basepkg.FrameBatch {
+		return
+	}
+
+	var req daemonRequest
+	if err := json.Unmarshal(f.Payload, &req); err != nil {
+		d.reply(fc, f.ID, fmt.Errorf("malformed request: %w", err))
+		return
+	}
+
+	// the client sends nothing after its request, a read returning means it went away
+	ctx, cancel := context.WithCancel(context.Background())
+	defer cancel()
+	go func() {
+		for {
+			if _, err := fc.ReadFrame(); err != nil {
+				cancel()
+				return
+			}
+		}
+	}()
+
+	out := fc.ChunkWriter(f.ID, 0, false)
+	if req.Stats {
+		d.writeStats(out)
+		d.reply(fc, f.ID, nil)
+		return
+	}
+	d.reply(fc, f.ID, d.run(ctx, req.Args, out))
+}
+
+// run parses a forwarded command line and runs it with the daemon's session
+func (d *daemon) run(ctx context.Context, args []string, out io.Writer) error {
+	cfg, message, err := parseArgs(append([]string{"master"}, args...))
+	if err != nil {
+		return err
+	}
+	if cfg.daemon {
+		return fmt.Errorf("--daemon can't be forwarded to a daemon")
+	}
+	cfg.out = out
+
+	d.runs.Add(1)
+	d.active.Add(1)
+	start := time.Now()
+	err = run(ctx, cfg, d.session, message)
+	d.busy.Add(int64(time.Since(start)))
+	d.active.Add(-1)
+
+	if err != nil {
+		d.failed.Add(1)
+	}
+	return err
+}
+
+// reply ends a run, reporting err to the client
+func (d *daemon) reply(fc *basepkg.FrameConn, id uint64, err error) {
+	var reply daemonReply
+	if err != nil {
+		reply.Error = err.Error()
+	}
+	payload, _ := json.Marshal(reply)
+	fc.WriteFrame(basepkg.Frame{ID: id, Type: basepkg.FrameBatchResponse, Payload: payload})
+}
+
+// writeStats prints the daemon's metrics
+func (d *daemon) writeStats(w io.Writer) {
+	runs := d.runs.Load()
+	active := d.active.Load()
+
+	fmt.Fprintf(w, "uptime: %s\n", time.Since(d.started).Round(time.Second))
+	fmt.Fprintf(w, "runs: %d (%d failed, %d active)\n", runs, d.failed.Load(), active)
+	if finished := int64(runs) - active; finished > 0 {
+		fmt.Fprintf(w, "average run: %s\n", (time.Duration(d.busy.Load()) / time.Duration(finished)).Round(time.Millisecond))
+	}
+	if d.session.cache != nil {
+		hits, misses := d.session.cache.Stats()
+		fmt.Fprintf(w, "plan cache: %d hits, %d misses\n", hits, misses)
+	}
+	fmt.Fprintf(w, "coalesced LLM calls: %d\n", basepkg.CoalescedCalls())
+	fmt.Fprintf(w, "slave connections: %d\n", d.session.slaves.size())
+}
+
+// forwardToDaemon sends the run described by args to the daemon at cfg.socket and prints its output
+// an interrupt closes the connection, which cancels the run in the daemon
+func forwardToDaemon(cfg *config, args []string) error {
+	conn, err := net.DialTimeout("unix", cfg.socket, cfg.timeout)
+	if err != nil {
+		return fmt.Errorf("could not reach daemon at %s: %w", cfg.socket, err)
+	}
+	fc := basepkg.NewFrameConn(conn)
+	defer fc.Close()
+
+	req := daemonRequest{Stats: cfg.daemonStats}
+	if !req.Stats {
+		if req.Args, err = forwardedArgs(args); err != nil {
+			return err
+		}
+	}
+	payload, err := json.Marshal(req)
+	if err != nil {
+		return fmt.Errorf("could not marshal request: %w", err)
+	}
+	if err := fc.WriteFrame(basepkg.Frame{ID: 1, Type: basepkg.FrameBatch, Payload: payload}); err != nil {
+		return fmt.Errorf("failed to send request to daemon: %w", err)
+	}
+
+	sigChan := make(chan os.Signal, 1)
+	signal.Notify(sigChan, os.Interrupt)
+	go func() {
+		<-sigChan
+		fmt.Println("\nreceived interrupt signal, shutting down...")
+		fc.Close()
+	}()
+
+	for {
+		f, err := fc.ReadFrame()
+		if err != nil {
+			return fmt.Errorf("lost connection to daemon: %w", err)
+		}
+
+		switch f.Type {
+		case basepkg.FrameChunk:
+			_, data, err := basepkg.ParseChunk(f.Payload)
+			if err != nil {
+				return err
+			}
+			os.Stdout.Write(data)
+		case basepkg.FrameBatchResponse:
+			var reply daemonReply
+			if err := json.Unmarshal(f.Payload, &reply); err != nil {
+				return fmt.Errorf("failed to unmarshal reply from daemon: %w", err)
+			}
+			if reply.Error != "" {
+				return errors.New(reply.Error)
+			}
+			return nil
+		}
+	}
+}
+
+// forwardedArgs returns args with the values of path flags made absolute
+func forwardedArgs(args []string) ([]string, error) {
+	forwarded := append([]string(nil), args...)
+	for i := 0; i < len(forwarded)-1; i++ {
+		if !pathFlags[forwarded[i]] {
+			continue
+		}
+		abs, err := filepath.Abs(forwarded[i+1])
+		if err != nil {
+			return nil, fmt.Errorf("could not resolve %s: %w", forwarded[i+1], err)
+		}
+		forwarded[i+1] = abs
+		i++
+	}
+	return forwarded, nil
+}
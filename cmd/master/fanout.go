@@ -0,0 +1,131 @@
+package main
+
+import (
+	"bufio"
+	"context"
+	"fmt"
+	"os"
+	"strings"
+	"sync"
+
+	basepkg "github.com/neofytr/opSmith/base"
+)
+
+// hostResult is the outcome of running a plan on one slave
+type hostResult struct {
+	addr     string
+	response basepkg.BatchResponse
+	err      error
+}
+
+// readInventory reads slave addresses from path, one IP:port per line
+// blank lines and lines starting with # are skipped
+func readInventory(path string) ([]string, error) {
+	file, err := os.Open(path)
+	if err != nil {
+		return nil, fmt.Errorf("could not open inventory %s: %w", path, err)
+	}
+	defer file.Close()
+
+	var hosts []string
+	scanner := bufio.NewScanner(file)
+	for scanner.Scan() {
+		line := strings.TrimSpace(scanner.Text())
+		if line == "" || strings.HasPrefix(line, "#") {
+			continue
+		}
+		hosts = append(hosts, line)
+	}
+	if err := scanner.Err(); err != nil {
+		return nil, fmt.Errorf("could not read inventory %s: %w", path, err)
+	}
+
+	if len(hosts) == 0 {
+		return nil, fmt.Errorf("inventory %s lists no slaves", path)
+	}
+	return hosts, nil
+}
+
+// runOnHost sends the plan to one slave, connecting and running are bounded by cfg.hostTimeout,
+// running also by cfg.execTimeout; when ctx ends the slave is told to stop the batch
+func runOnHost(ctx context.Context, cfg *config, s *session, addr string, commandJSON []byte, flags byte) hostResult {
+	ctx, cancel := context.WithTimeout(ctx, cfg.hostTimeout)
+	defer cancel()
+
+	dialTimeout := cfg.timeout
+	if cfg.hostTimeout < dialTimeout {
+		dialTimeout = cfg.hostTimeout
+	}
+
+	client, release, err := s.slave(addr, dialTimeout)
+	if err != nil {
+		return hostResult{addr: addr, err: err}
+	}
+	defer release()
+
+	ctx, cancelExec := withExecTimeout(ctx, cfg)
+	defer cancelExec()
+
+	resp, err := client.Do(ctx, commandJSON, flags)
+	if err != nil {
+		return hostResult{addr: addr, err: fmt.Errorf("failed to get response from slave: %w", err)}
+	}
+	if resp.Error != "" {
+		return hostResult{addr: addr, err: fmt.Errorf("slave could not run batch: %s", resp.Error)}
+	}
+
+	return hostResult{addr: addr, response: resp}
+}
+
+// fanOut runs the plan on every host with at most cfg.fanout hosts in flight
+// results are returned in the order of cfg.hosts, hosts not started when ctx ends fail with its error
+func fanOut(ctx context.Context, cfg *config, s *session, commandJSON string) []hostResult {
+	var flags byte
+	if cfg.parallel {
+		flags |= basepkg.FlagParallel
+	}
+
+	data := []byte(commandJSON)
+	results := make([]hostResult, len(cfg.hosts))
+	sem := make(chan struct{}, cfg.fanout)
+
+	var wg sync.WaitGroup
+	for i, addr := range cfg.hosts {
+		select {
+		case sem <- struct{}{}:
+		case <-ctx.Done():
+			results[i] = hostResult{addr: addr, err: ctx.Err()}
+			continue
+		}
+		wg.Add(1)
+		go func(i int, addr string) {
+			defer wg.Done()
+			defer func() { <-sem }()
+			results[i] = runOnHost(ctx, cfg, s, addr, data, flags)
+		}(i, addr)
+	}
+	wg.Wait()
+
+	return results
+}
+
+// fanOutToSlaves runs the plan on all slaves and prints the aggregated results
+func fanOutToSlaves(ctx context.Context, cfg *config, s *session, commandJSON string, originalQuestion string) error {
+	results := fanOut(ctx, cfg, s, commandJSON)
+	printHostResults(ctx, cfg, s.llm, results, originalQuestion)
+
+	failedHosts := 0
+	for _, host := range results {
+		if host.err != nil || host.response.Status != basepkg.StatusOK {
+			failedHosts++
+		}
+	}
+
+	if cfg.format != formatJSON {
+		fmt.Fprintf(cfg.out, "%d of %d hosts succeeded\n", len(results)-failedHosts, len(results))
+	}
+	if failedHosts > 0 {
+		return fmt.Errorf("%d hosts failed", failedHosts)
+	}
+	return nil
+}
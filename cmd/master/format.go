@@ -0,0 +1,165 @@
+package main
+
+import (
+	"context"
+	"encoding/json"
+	"fmt"
+	"io"
+	"strings"
+
+	basepkg "github.com/neofytr/opSmith/base"
+)
+
+// result formats selectable with --format
+const (
+	formatPlain = "plain" // local, deterministic text
+	formatJSON  = "json"  // machine readable report
+	formatLLM   = "llm"   // summary written by the AI, costs a second model call
+)
+
+// validFormat reports whether format is a known result format
+func validFormat(format string) bool {
+	return format == formatPlain || format == formatJSON || format == formatLLM
+}
+
+// jsonReport is the --format json output for a single slave
+type jsonReport struct {
+	Question string             `json:"question"`
+	Status   int                `json:"status"`
+	Results  []basepkg.Response `json:"results"`
+}
+
+// jsonHostReport is one slave in the --format json output of a fan-out
+type jsonHostReport struct {
+	Host    string             `json:"host"`
+	Status  int                `json:"status"`
+	Error   string             `json:"error,omitempty"`
+	Results []basepkg.Response `json:"results,omitempty"`
+}
+
+// printResults presents the results of a batch in the format chosen by cfg
+func printResults(ctx context.Context, cfg *config, llm *basepkg.LLMClient, batchResp basepkg.BatchResponse, originalQuestion string) error {
+	switch cfg.format {
+	case formatJSON:
+		return printJSON(cfg.out, jsonReport{Question: originalQuestion, Status: batchResp.Status, Results: batchResp.Results})
+	case formatLLM:
+		if summarizeWithAI(ctx, cfg, llm, originalQuestion, resultsForAI(batchResp.Results)) == nil {
+			return nil
+		}
+		// fallback to plain formatting if AI fails
+	}
+
+	fmt.Fprintf(cfg.out, "=== Results for: %s ===\n\n", originalQuestion)
+	writePlainResults(cfg.out, batchResp.Results)
+	return nil
+}
+
+// printHostResults presents the results of a fan-out in the format chosen by cfg
+func printHostResults(ctx context.Context, cfg *config, llm *basepkg.LLMClient, results []hostResult, originalQuestion string) {
+	switch cfg.format {
+	case formatJSON:
+		hosts := make([]jsonHostReport, len(results))
+		for i, host := range results {
+			hosts[i] = jsonHostReport{Host: host.addr, Status: host.response.Status, Results: host.response.Results}
+			if host.err != nil {
+				hosts[i].Status = basepkg.StatusError
+				hosts[i].Error = host.err.Error()
+			}
+		}
+		printJSON(cfg.out, struct {
+			Question string           `json:"question"`
+			Hosts    []jsonHostReport `json:"hosts"`
+		}{originalQuestion, hosts})
+		return
+	case formatLLM:
+		var text []string
+		for _, host := range results {
+			if host.err != nil {
+				text = append(text, fmt.Sprintf("Host %s: Unreachable\nError: %v", host.addr, host.err))
+			} else {
+				text = append(text, fmt.Sprintf("Host %s:\n%s", host.addr, resultsForAI(host.response.Results)))
+			}
+		}
+		if summarizeWithAI(ctx, cfg, llm, originalQuestion, strings.Join(text, "\n\n")) == nil {
+			return
+		}
+	}
+
+	fmt.Fprintf(cfg.out, "=== Results for: %s (%d hosts) ===\n\n", originalQuestion, len(results))
+	for _, host := range results {
+		fmt.Fprintf(cfg.out, "--- %s ---\n", host.addr)
+		if host.err != nil {
+			fmt.Fprintf(cfg.out, "✗ Unreachable: %v\n\n", host.err)
+			continue
+		}
+		writePlainResults(cfg.out, host.response.Results)
+	}
+}
+
+// writePlainResults writes results in the plain text layout
+func writePlainResults(w io.Writer, results []basepkg.Response) {
+	for i, result := range results {
+		fmt.Fprintf(w, "Command %d ->\n", i+1)
+		if result.Status == basepkg.StatusOK {
+			fmt.Fprintf(w, "✓ Success\nResponse Data ->\n%s\n\n", result.Data)
+		} else {
+			fmt.Fprintf(w, "✗ Failed: %s\n\n", result.Error)
+		}
+	}
+}
+
+// printJSON writes v as indented json to w
+func printJSON(w io.Writer, v any) error {
+	encoder := json.NewEncoder(w)
+	encoder.SetIndent("", "  ")
+	if err := encoder.Encode(v); err != nil {
+		return fmt.Errorf("could not encode results: %w", err)
+	}
+	return nil
+}
+
+// resultsForAI renders results as the text handed to the formatting model
+func resultsForAI(results []basepkg.Response) string {
+	var formattedResults []string
+	for i, result := range results {
+		if result.Status == basepkg.StatusOK {
+			formattedResults = append(formattedResults, fmt.Sprintf("Command %d: Success\nData: %s", i+1, result.Data))
+		} else {
+			formattedResults = append(formattedResults, fmt.Sprintf("Command %d: Failed\nError: %s", i+1, result.Error))
+		}
+	}
+	return strings.Join(formattedResults, "\n\n")
+}
+
+// summarizeWithAI asks the formatting model to present results and prints its answer
+// the answer takes at most cfg.timeout and is given up when ctx ends
+func summarizeWithAI(ctx context.Context, cfg *config, llm *basepkg.LLMClient, originalQuestion, results string) error {
+	// prepare AI prompt for formatting
+	aiFormattingPrompt := fmt.Sprintf(`You are a helpful assistant that presents command execution results in a friendly, formatted way.
+
+Original user question: "%s"
+
+Command execution results:
+%s
+
+Please provide a friendly, well-formatted response that:
+1. Acknowledges the user's original question
+2. Presents the results in a clear, readable format
+3. Summarizes what was accomplished
+4. Uses a conversational tone
+
+Respond directly without any JSON formatting.`, originalQuestion, results)
+
+	// get AI formatting response
+	ctx, cancel := context.WithTimeout(ctx, cfg.timeout)
+	defer cancel()
+
+	aiResponse, err := llm.GetResponseWithOptions(ctx, aiFormattingPrompt, formatModel, basepkg.GenerateOptions{NumPredict: summaryTokens})
+	if err != nil {
+		return err
+	}
+
+	// print AI-formatted response
+	fmt.Fprintf(cfg.out, "%s\n", strings.TrimSpace(aiResponse))
+	return nil
+}
@@ -9,7 +9,10 @@ import (
 	"net"
 	"os"
 	"os/signal"
+	"path/filepath"
+	"strconv"
 	"strings"
+	"sync"
 	"time"
 
 	basepkg "github.com/neofytr/opSmith/base"
@@ -21,12 +24,26 @@ const loggingEnabled = false
 const aiPrompt = `You are a command-generating assistant that converts natural language to executable commands.
 
 Available commands:
-1. ReadFile <file_path> - reads entire file contents
+1. ReadFile <file_path> [<range> ...] - reads file contents, all of them unless a range is given:
+    offset=<n> and length=<n> for a byte range, last_bytes=<n> or last_lines=<n> for the end of the file;
+    use last_lines for logs and other large files, e.g. ["/var/log/syslog", "last_lines=100"]
 2. WriteFile <file_path> <content> - writes content to file (doesn't create the file if it doesn't exist)
 3. CreateFile <file_path> - creates a new file (truncates it if it exists); can't write content using CreateFile
 4. DeleteFile <file_path> - deletes the specified file
 5. AppendFile <file_path> <content> - appends content to the end of the file (creates file if it doesn't exist)
-6. CommandExec <command_to_execute> - executes the bash command <command_to_execute> in the shell
+6. ListDir <directory_path> - lists a directory, one "<type> <size> <name>" line per entry
+7. Stat <path> - shows type, size, permissions and modification time of a file or directory
+8. Head <file_path> [<lines>] - first lines of a file (10 unless given)
+9. Tail <file_path> [<lines>] - last lines of a file (10 unless given)
+10. Grep <path> <regex> - lines matching the regular expression in a file, or in every file below a directory
+11. DiskUsage <path> - total size in bytes of a file or of everything below a directory
+12. Glob <pattern> - paths matching a shell wildcard pattern such as /var/log/*.log
+13. WalkTree <directory_path> [<filter> ...] - finds entries below a directory like find; filters are
+    name=<wildcard>, type=f|d, min_size=<bytes>, max_size=<bytes>, newer=<age like 24h or date>,
+    older=<age or date>, limit=<n>, e.g. ["/var/log", "name=*.log", "min_size=1048576"]
+14. CommandExec <command_to_execute> - executes the bash command <command_to_execute> in the shell
+
+Prefer commands 1-13 over CommandExec whenever they can answer the request, they are much faster.
 
 Respond with:
 {
@@ -36,15 +53,55 @@ Respond with:
   ]
 }
 
+Commands may run concurrently. A command can list the indices (starting at 0) of earlier commands it must wait for:
+    {"name": "<CommandName>", "args": ["<arg1>"], "depends_on": [0, 2]}
+Use "depends_on": [] for a CommandExec that does not depend on any other command.
+A command that might hang or run long can carry a time limit in milliseconds: "timeout_ms": 10000
+
 Only return valid JSON, no extra text.
 
-User request: `
+`
+
+// planRequest is the part of the plan prompt after aiPrompt, aiPrompt alone is the same for every plan
+func planRequest(message string) string {
+	return "User request: " + message
+}
 
 // config holds master configuration
 type config struct {
-	clientIP   string
-	clientPort string
-	timeout    time.Duration
+	clientIP    string
+	clientPort  string
+	timeout     time.Duration
+	execTimeout time.Duration // how long the slave may run the batch, 0 for no limit
+	parallel    bool          // let the slave run independent commands concurrently
+	stream      bool          // print primitive output as the slave produces it
+	rawDir      string        // with stream, file contents are received raw into this directory
+
+	noCache    bool          // always ask the LLM, never use cached plans
+	cacheDir   string        // where cached plans are persisted
+	cacheTTL   time.Duration // how long a cached plan stays valid
+	cacheStats bool          // print plan cache hit/miss counters after the run
+
+	pipeline bool // send each command to the slave as soon as the model has generated it
+
+	keepAlive   time.Duration // how long Ollama keeps the models loaded between runs
+	numCtx      int           // context window of the models, 0 for their default
+	temperature *float64      // sampling temperature, nil for the model's default
+	preload     bool          // load the models of the run in the background right at start
+
+	hosts       []string      // host:port of every slave when fanning out to many
+	fanout      int           // how many slaves are contacted at once
+	hostTimeout time.Duration // time limit for one slave, connecting included
+
+	format string // how results are presented: plain, json or llm
+
+	prompts        []string // with --batch-file, every line is a request of its own
+	llmConcurrency int      // how many plans are generated at once in batch mode
+
+	daemon      bool      // serve requests from the socket instead of running one
+	socket      string    // unix socket of the daemon, without --daemon the run is forwarded to it
+	daemonStats bool      // print the daemon's metrics instead of running a request
+	out         io.Writer // where results are printed, the client's connection in the daemon
 }
 
 // parseArgs parses command line arguments
@@ -53,7 +110,7 @@ func parseArgs(args []string) (*config, string, error) {
 		return nil, "", fmt.Errorf("insufficient arguments")
 	}
 
-	cfg := &config{timeout: 30 * time.Second}
+	cfg := &config{timeout: 30 * time.Second, cacheTTL: time.Hour, fanout: 32, hostTimeout: 5 * time.Minute, format: formatPlain, llmConcurrency: 4, keepAlive: 30 * time.Minute, out: os.Stdout}
 	var command string
 
 	// parse arguments
@@ -82,6 +139,157 @@ func parseArgs(args []string) (*config, string, error) {
 			}
 			cfg.timeout = duration
 			i++
+		case "--exec-timeout":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--exec-timeout requires a duration")
+			}
+			duration, err := time.ParseDuration(args[i+1])
+			if err != nil {
+				return nil, "", fmt.Errorf("invalid exec timeout format: %w", err)
+			}
+			cfg.execTimeout = duration
+			i++
+		case "--parallel":
+			cfg.parallel = true
+		case "--stream":
+			cfg.stream = true
+		case "--raw-dir":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--raw-dir requires a directory")
+			}
+			cfg.rawDir = args[i+1]
+			cfg.stream = true
+			i++
+		case "--clients":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--clients requires a comma separated list of IP:port")
+			}
+			for _, host := range strings.Split(args[i+1], ",") {
+				if host = strings.TrimSpace(host); host != "" {
+					cfg.hosts = append(cfg.hosts, host)
+				}
+			}
+			i++
+		case "--inventory":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--inventory requires a file path")
+			}
+			hosts, err := readInventory(args[i+1])
+			if err != nil {
+				return nil, "", err
+			}
+			cfg.hosts = append(cfg.hosts, hosts...)
+			i++
+		case "--fanout":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--fanout requires a number")
+			}
+			fanout, err := strconv.Atoi(args[i+1])
+			if err != nil || fanout < 1 {
+				return nil, "", fmt.Errorf("invalid fanout %s", args[i+1])
+			}
+			cfg.fanout = fanout
+			i++
+		case "--host-timeout":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--host-timeout requires a duration")
+			}
+			duration, err := time.ParseDuration(args[i+1])
+			if err != nil {
+				return nil, "", fmt.Errorf("invalid host timeout format: %w", err)
+			}
+			cfg.hostTimeout = duration
+			i++
+		case "--format":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--format requires plain, json or llm")
+			}
+			cfg.format = args[i+1]
+			i++
+		case "--batch-file":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--batch-file requires a file path")
+			}
+			prompts, err := readPrompts(args[i+1])
+			if err != nil {
+				return nil, "", err
+			}
+			cfg.prompts = prompts
+			i++
+		case "--llm-concurrency":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--llm-concurrency requires a number")
+			}
+			n, err := strconv.Atoi(args[i+1])
+			if err != nil || n < 1 {
+				return nil, "", fmt.Errorf("invalid llm concurrency %s", args[i+1])
+			}
+			cfg.llmConcurrency = n
+			i++
+		case "--pipeline":
+			cfg.pipeline = true
+		case "--keep-alive":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--keep-alive requires a duration")
+			}
+			duration, err := time.ParseDuration(args[i+1])
+			if err != nil {
+				return nil, "", fmt.Errorf("invalid keep alive format: %w", err)
+			}
+			cfg.keepAlive = duration
+			i++
+		case "--num-ctx":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--num-ctx requires a number")
+			}
+			n, err := strconv.Atoi(args[i+1])
+			if err != nil || n < 1 {
+				return nil, "", fmt.Errorf("invalid context size %s", args[i+1])
+			}
+			cfg.numCtx = n
+			i++
+		case "--temperature":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--temperature requires a number")
+			}
+			t, err := strconv.ParseFloat(args[i+1], 64)
+			if err != nil || t < 0 {
+				return nil, "", fmt.Errorf("invalid temperature %s", args[i+1])
+			}
+			cfg.temperature = &t
+			i++
+		case "--preload":
+			cfg.preload = true
+		case "--no-cache":
+			cfg.noCache = true
+		case "--cache-dir":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--cache-dir requires a directory")
+			}
+			cfg.cacheDir = args[i+1]
+			i++
+		case "--cache-ttl":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--cache-ttl requires a duration")
+			}
+			ttl, err := time.ParseDuration(args[i+1])
+			if err != nil {
+				return nil, "", fmt.Errorf("invalid cache ttl format: %w", err)
+			}
+			cfg.cacheTTL = ttl
+			i++
+		case "--cache-stats":
+			cfg.cacheStats = true
+		case "--daemon":
+			cfg.daemon = true
+		case "--socket":
+			if i+1 >= len(args) {
+				return nil, "", fmt.Errorf("--socket requires a path")
+			}
+			cfg.socket = args[i+1]
+			i++
+		case "--daemon-stats":
+			cfg.daemonStats = true
 		case "--run-from-file":
 			if i+1 >= len(args) {
 				return nil, "", fmt.Errorf("--run-from-file requires a file path")
@@ -106,125 +314,453 @@ func parseArgs(args []string) (*config, string, error) {
 			if command == "" {
 				return nil, "", fmt.Errorf("file is empty or contains only whitespace")
 			}
+		default:
+			if format, ok := strings.CutPrefix(args[i], "--format="); ok {
+				cfg.format = format
+			}
 		}
 	}
 
-	if cfg.clientIP == "" || cfg.clientPort == "" {
+	if !validFormat(cfg.format) {
+		return nil, "", fmt.Errorf("unknown format %s, use plain, json or llm", cfg.format)
+	}
+
+	// the daemon takes its requests from the socket, stats need nothing but the socket
+	if cfg.daemon || cfg.daemonStats {
+		if cfg.socket == "" {
+			cfg.socket = defaultSocketPath()
+		}
+		return cfg, command, nil
+	}
+
+	// a single --client joins the fan-out list when there is one
+	if len(cfg.hosts) > 0 && cfg.clientIP != "" {
+		cfg.hosts = append([]string{net.JoinHostPort(cfg.clientIP, cfg.clientPort)}, cfg.hosts...)
+	}
+
+	if len(cfg.hosts) == 0 && (cfg.clientIP == "" || cfg.clientPort == "") {
 		return nil, "", fmt.Errorf("client IP and port must be specified")
 	}
 
-	if command == "" {
+	if len(cfg.prompts) > 0 {
+		if len(cfg.hosts) > 0 {
+			return nil, "", fmt.Errorf("--batch-file works with a single --client")
+		}
+		if command != "" {
+			return nil, "", fmt.Errorf("--batch-file can't be combined with --run or --run-from-file")
+		}
+	} else if command == "" {
 		return nil, "", fmt.Errorf("command must be specified with --run")
 	}
 
 	return cfg, command, nil
 }
 
-// generateCommands uses AI to convert natural language to commands
-func generateCommands(ctx context.Context, message string) (string, error) {
-	// create llm client
-	config := basepkg.CreateConfig(basepkg.Codellama, "", "", 1200*time.Second)
-	client := basepkg.NewLLMClient(config)
+// models used to turn requests into command plans and to present results
+const (
+	generateModel = basepkg.Codellama
+	formatModel   = basepkg.Llama2
+)
+
+// token budgets of the prompts, well above what a good answer takes, they stop a model that
+// rambles on instead of answering; a plan usually ends earlier, when its JSON object is complete
+const (
+	planTokens    = 1024 // a plan of a dozen commands takes a few hundred tokens
+	summaryTokens = 768
+)
+
+// planOptions are the model options of plan generation
+var planOptions = basepkg.GenerateOptions{NumPredict: planTokens}
+
+// planComplete returns a function that reports when the streamed tokens completed a plan object
+func planComplete() func(token string) bool {
+	parser := basepkg.NewPlanParser()
+	return func(token string) bool {
+		parser.Feed(token) // a malformed plan is reported when the plan is parsed
+		return parser.Done()
+	}
+}
+
+// planText cuts the plan object out of a response, the whole response when it holds no complete object
+func planText(response string) string {
+	parser := basepkg.NewPlanParser()
+	if parser.Feed(response); parser.Done() {
+		return parser.Plan()
+	}
+	return strings.TrimSpace(response)
+}
+
+// openPlanCache opens the plan cache described by cfg, nil when caching is disabled
+func openPlanCache(cfg *config) *basepkg.PlanCache {
+	if cfg.noCache || cfg.cacheTTL <= 0 {
+		return nil
+	}
+
+	dir := cfg.cacheDir
+	if dir == "" {
+		var err error
+		if dir, err = basepkg.DefaultPlanCacheDir(); err != nil {
+			dir = "" // fall back to memory only
+		}
+	}
+
+	cache, err := basepkg.NewPlanCache(dir, cfg.cacheTTL)
+	if err != nil {
+		fmt.Fprintf(cfg.out, "warning: %v, plan cache is memory only\n", err)
+		cache, _ = basepkg.NewPlanCache("", cfg.cacheTTL)
+	}
+	return cache
+}
+
+// cachedPlan returns a cached plan for message, if any
+func cachedPlan(cache *basepkg.PlanCache, message string) (string, bool) {
+	if cache == nil {
+		return "", false
+	}
+	return cache.Get(basepkg.PlanKey(message, generateModel, aiPrompt))
+}
+
+// storePlan caches plan for message, only plans that parse as a non-empty batch are kept
+func storePlan(cache *basepkg.PlanCache, message, plan string) {
+	if cache == nil {
+		return
+	}
+
+	var batch basepkg.Batch
+	if json.Unmarshal([]byte(plan), &batch) != nil || len(batch.Commands) == 0 {
+		return
+	}
 
+	if err := cache.Put(basepkg.PlanKey(message, generateModel, aiPrompt), plan); err != nil && loggingEnabled {
+		log.Default().Printf("could not cache plan: %v", err)
+	}
+}
+
+// generateCommands uses AI to convert natural language to commands, the plan is cached
+// generation stops as soon as the plan object is complete, whatever the model would add is never generated
+func generateCommands(ctx context.Context, llm *basepkg.LLMClient, message string, cache *basepkg.PlanCache) (string, error) {
 	// get ai response
-	response, err := client.GetResponse(ctx, aiPrompt+message)
+	response, err := llm.GetResponseUntil(ctx, aiPrompt, planRequest(message), generateModel, planOptions, planComplete())
 	if err != nil {
 		return "", fmt.Errorf("failed to get AI response: %w", err)
 	}
 
-	return strings.TrimSpace(response), nil
+	plan := planText(response)
+	storePlan(cache, message, plan)
+
+	return plan, nil
 }
 
-// sendToSlave sends commands to slave and returns response
-func sendToSlave(cfg *config, commandJSON string, originalQuestion string) error {
-	// connect to slave
-	conn, err := net.DialTimeout("tcp", cfg.clientIP+":"+cfg.clientPort, cfg.timeout)
-	if err != nil {
-		return fmt.Errorf("failed to connect to slave at %s:%s: %w", cfg.clientIP, cfg.clientPort, err)
+// withExecTimeout bounds ctx by cfg.execTimeout when one is set
+func withExecTimeout(ctx context.Context, cfg *config) (context.Context, context.CancelFunc) {
+	if cfg.execTimeout > 0 {
+		return context.WithTimeout(ctx, cfg.execTimeout)
 	}
-	defer conn.Close()
+	return context.WithCancel(ctx)
+}
 
-	// send command
-	_, err = conn.Write([]byte(commandJSON))
-	if err != nil {
-		return fmt.Errorf("failed to send command to slave: %w", err)
+// sendToSlave sends commands to slave over client and prints the response
+// when ctx ends or cfg.execTimeout passes, the slave is told to stop the batch
+func sendToSlave(ctx context.Context, cfg *config, llm *basepkg.LLMClient, client *basepkg.SlaveClient, commandJSON string, originalQuestion string) error {
+	execCtx, cancel := withExecTimeout(ctx, cfg)
+	defer cancel()
+
+	var flags byte
+	if cfg.parallel {
+		flags |= basepkg.FlagParallel
+	}
+
+	if cfg.stream {
+		return streamFromSlave(execCtx, cfg, client, commandJSON, flags, originalQuestion)
 	}
 
-	// read response
-	buf := make([]byte, 8192) // larger buffer for multiple responses
-	n, err := conn.Read(buf)
+	batchResp, err := client.Do(execCtx, []byte(commandJSON), flags)
 	if err != nil {
-		return fmt.Errorf("failed to read response from slave: %w", err)
+		return fmt.Errorf("failed to get response from slave: %w", err)
 	}
 
-	responseData := buf[:n]
 	if loggingEnabled {
-		log.Default().Printf("received response from slave: %s", string(responseData))
+		log.Default().Printf("received response from slave: %+v", batchResp)
+	}
+
+	if batchResp.Error != "" {
+		return fmt.Errorf("slave could not run batch: %s", batchResp.Error)
+	}
+
+	return printResults(ctx, cfg, llm, batchResp, originalQuestion)
+}
+
+// streamFromSlave runs the batch in stream mode, printing output while the slave produces it
+// with cfg.rawDir set, file contents are spliced into <rawDir>/command-<n>.out instead
+func streamFromSlave(ctx context.Context, cfg *config, client *basepkg.SlaveClient, commandJSON string, flags byte, originalQuestion string) error {
+	fmt.Fprintf(cfg.out, "=== Results for: %s ===\n", originalQuestion)
+
+	output := newStreamOutput(cfg)
+	if cfg.rawDir != "" {
+		flags |= basepkg.FlagRaw
+	}
+
+	batchResp, err := client.DoStream(ctx, []byte(commandJSON), flags|basepkg.FlagStream, output.handlers(0))
+	output.close()
+	if err != nil {
+		return fmt.Errorf("failed to get response from slave: %w", err)
+	}
+
+	if batchResp.Error != "" {
+		return fmt.Errorf("slave could not run batch: %s", batchResp.Error)
 	}
 
-	// parse as batch response first
-	var batchResp basepkg.BatchResponse
-	if err := json.Unmarshal(responseData, &batchResp); err == nil {
-		// create formatted response for AI
-		var formattedResults []string
-		for i, result := range batchResp.Results {
-			if result.Status == basepkg.StatusOK {
-				formattedResults = append(formattedResults, fmt.Sprintf("Command %d: Success\nData: %s", i+1, result.Data))
-			} else {
-				formattedResults = append(formattedResults, fmt.Sprintf("Command %d: Failed\nError: %s", i+1, result.Error))
+	output.printResults(batchResp)
+	return nil
+}
+
+// streamOutput prints streamed output as it arrives, raw file contents go to files in cfg.rawDir
+// its handlers run on the client's read goroutine one at a time, the raw files are shared with
+// close, which may run while output of an abandoned batch still arrives; output goes through a
+// queue of its own, a slow reader of cfg.out, like a daemon client, doesn't hold up the
+// slave connection and the batches pipelined on it
+type streamOutput struct {
+	cfg     *config
+	out     *queuedWriter
+	current int // command whose output was printed last
+
+	mu       sync.Mutex
+	rawFiles map[int]*os.File
+	closed   bool
+}
+
+func newStreamOutput(cfg *config) *streamOutput {
+	return &streamOutput{cfg: cfg, out: newQueuedWriter(cfg.out), current: -1, rawFiles: make(map[int]*os.File)}
+}
+
+// handlers receive the output of a batch whose first command is command first of the plan
+func (o *streamOutput) handlers(first int) basepkg.StreamHandlers {
+	handlers := basepkg.StreamHandlers{
+		OnChunk: func(index int, data []byte) {
+			if index += first; index != o.current {
+				fmt.Fprintf(o.out, "\nCommand %d ->\n", index+1)
+				o.current = index
 			}
+			o.out.Write(data)
+		},
+	}
+
+	if o.cfg.rawDir != "" {
+		handlers.OnRaw = func(index int) io.Writer {
+			index += first
+			o.mu.Lock()
+			defer o.mu.Unlock()
+			if o.closed {
+				return nil // the run is over, the bytes are dropped with its other output
+			}
+			if file, ok := o.rawFiles[index]; ok {
+				return file
+			}
+			file, err := os.Create(filepath.Join(o.cfg.rawDir, fmt.Sprintf("command-%d.out", index+1)))
+			if err != nil {
+				fmt.Fprintf(o.out, "could not store output of command %d: %v\n", index+1, err)
+				return nil
+			}
+			o.rawFiles[index] = file
+			return file
 		}
+	}
+	return handlers
+}
 
-		// prepare AI prompt for formatting
-		aiFormattingPrompt := fmt.Sprintf(`You are a helpful assistant that presents command execution results in a friendly, formatted way.
+// close closes the raw files and waits until the queued output is written, once no more
+// output arrives; closing again does nothing
+func (o *streamOutput) close() {
+	o.mu.Lock()
+	if o.closed {
+		o.mu.Unlock()
+		return
+	}
+	o.closed = true
+	for _, file := range o.rawFiles {
+		file.Close()
+	}
+	o.mu.Unlock()
+	o.out.Close()
+}
 
-Original user question: "%s"
+// printResults reports how every command ended, after close; streamed output was already
+// printed and buffered primitives still carry their data
+func (o *streamOutput) printResults(batchResp basepkg.BatchResponse) {
+	o.mu.Lock()
+	defer o.mu.Unlock()
+	fmt.Fprintln(o.cfg.out)
+	for i, result := range batchResp.Results {
+		if result.Status != basepkg.StatusOK {
+			fmt.Fprintf(o.cfg.out, "Command %d -> ✗ Failed: %s\n", i+1, result.Error)
+		} else if file, ok := o.rawFiles[i]; ok {
+			fmt.Fprintf(o.cfg.out, "Command %d -> ✓ Success, saved to %s\n", i+1, file.Name())
+		} else if result.Data != "" {
+			fmt.Fprintf(o.cfg.out, "Command %d -> ✓ Success\nResponse Data ->\n%s\n", i+1, result.Data)
+		} else {
+			fmt.Fprintf(o.cfg.out, "Command %d -> ✓ Success\n", i+1)
+		}
+	}
+}
 
-Command execution results:
-%s
+// maxQueuedOutput bounds the bytes a queuedWriter holds for a reader that fell behind
+const maxQueuedOutput = 16 << 20
+
+// queuedWriter copies writes onto a queue drained into w by a goroutine of its own, so writers
+// never wait for w; writes finding maxQueuedOutput bytes queued are dropped and a notice of
+// how much went missing follows once there is room again; a failed write to w drops everything after it
+type queuedWriter struct {
+	w    io.Writer
+	done chan struct{}
+
+	mu      sync.Mutex
+	queue   [][]byte
+	queued  int           // bytes in queue and not written yet
+	dropped int           // bytes dropped since the last notice
+	wake    chan struct{} // signalled when the queue gets data or the writer is closed
+	closed  bool
+}
 
-Please provide a friendly, well-formatted response that:
-1. Acknowledges the user's original question
-2. Presents the results in a clear, readable format
-3. Summarizes what was accomplished
-4. Uses a conversational tone
+func newQueuedWriter(w io.Writer) *queuedWriter {
+	q := &queuedWriter{w: w, done: make(chan struct{}), wake: make(chan struct{}, 1)}
+	go q.drain()
+	return q
+}
 
-Respond directly without any JSON formatting.`, originalQuestion, strings.Join(formattedResults, "\n\n"))
+func (q *queuedWriter) Write(p []byte) (int, error) {
+	q.mu.Lock()
+	switch {
+	case q.closed:
+	case q.queued+len(p) > maxQueuedOutput:
+		q.dropped += len(p)
+	default:
+		q.noteDropped()
+		q.queue = append(q.queue, append([]byte(nil), p...))
+		q.queued += len(p)
+	}
+	q.mu.Unlock()
 
-		// get AI formatting response
-		ctx, cancel := context.WithTimeout(context.Background(), cfg.timeout)
-		defer cancel()
+	select {
+	case q.wake <- struct{}{}:
+	default:
+	}
+	return len(p), nil
+}
 
-		config := basepkg.CreateConfig(basepkg.Llama2, "", "", 1200*time.Second)
-		client := basepkg.NewLLMClient(config)
+// Close waits until everything written before it reached w, later writes are dropped
+func (q *queuedWriter) Close() error {
+	q.mu.Lock()
+	if !q.closed {
+		q.noteDropped()
+		q.closed = true
+	}
+	q.mu.Unlock()
 
-		aiResponse, err := client.GetResponse(ctx, aiFormattingPrompt)
-		if err != nil {
-			// fallback to original formatting if AI fails
-			fmt.Printf("=== Results for: %s ===\n\n", originalQuestion)
-			for i, result := range batchResp.Results {
-				fmt.Printf("Command %d ->\n", i+1)
-				if result.Status == basepkg.StatusOK {
-					fmt.Printf("✓ Success\nResponse Data ->\n%s\n\n", result.Data)
-				} else {
-					fmt.Printf("✗ Failed: %s\n\n", result.Error)
-				}
+	select {
+	case q.wake <- struct{}{}:
+	default:
+	}
+	<-q.done
+	return nil
+}
+
+// noteDropped queues the notice for output dropped since the last one, q.mu must be held
+func (q *queuedWriter) noteDropped() {
+	if q.dropped > 0 {
+		notice := fmt.Sprintf("\n[%d bytes of output dropped, the reader fell behind]\n", q.dropped)
+		q.queue = append(q.queue, []byte(notice))
+		q.queued += len(notice)
+		q.dropped = 0
+	}
+}
+
+func (q *queuedWriter) drain() {
+	defer close(q.done)
+	failed := false
+	for {
+		q.mu.Lock()
+		queue, closed := q.queue, q.closed
+		q.queue = nil
+		q.mu.Unlock()
+
+		for _, data := range queue {
+			if !failed {
+				_, err := q.w.Write(data)
+				failed = err != nil
 			}
-		} else {
-			// print AI-formatted response
-			fmt.Printf("%s\n", strings.TrimSpace(aiResponse))
+			q.mu.Lock()
+			q.queued -= len(data)
+			q.mu.Unlock()
 		}
+		if closed && len(queue) == 0 {
+			return
+		}
+		if len(queue) == 0 {
+			<-q.wake
+		}
+	}
+}
 
-		return nil
+// session is what runs share beyond their config: the LLM client, the plan cache and the
+// connections to slaves; a plain run builds one for itself, the daemon keeps one warm
+type session struct {
+	llm    *basepkg.LLMClient
+	cache  *basepkg.PlanCache
+	slaves *slavePool // nil dials a fresh connection for every run
+}
+
+// newSession builds the session for cfg
+func newSession(cfg *config) *session {
+	// one LLM client serves generation and formatting, its connections are pooled and kept alive
+	// and the models stay loaded for cfg.keepAlive, so alternating between them doesn't reload them
+	llmCfg := basepkg.CreateConfig(generateModel, "", "", 1200*time.Second)
+	llmCfg.KeepAlive = cfg.keepAlive
+	llmCfg.Options = basepkg.GenerateOptions{NumCtx: cfg.numCtx, Temperature: cfg.temperature}
+	// aiPrompt goes as the system message of a chat where more than one plan is generated with it
+	llmCfg.ReusePrefixes = cfg.daemon || len(cfg.prompts) > 1
+
+	return &session{
+		llm:   basepkg.NewLLMClient(llmCfg),
+		cache: openPlanCache(cfg),
 	}
+}
 
-	return fmt.Errorf("failed to unmarshal response from slave -> %s", err)
+// modelsFor returns the models a run with cfg asks
+func modelsFor(cfg *config) []basepkg.Model {
+	if cfg.format == formatLLM {
+		return []basepkg.Model{generateModel, formatModel}
+	}
+	return []basepkg.Model{generateModel}
+}
+
+// preload loads models in the background, report receives the outcome for each of them
+func (s *session) preload(ctx context.Context, models []basepkg.Model, report func(model basepkg.Model, took time.Duration, err error)) {
+	for _, model := range models {
+		go func(model basepkg.Model) {
+			start := time.Now()
+			err := s.llm.Preload(ctx, model)
+			report(model, time.Since(start), err)
+		}(model)
+	}
+}
+
+// slave returns a connection to the slave at addr and the function that gives it back
+func (s *session) slave(addr string, timeout time.Duration) (*basepkg.SlaveClient, func(), error) {
+	if s.slaves != nil {
+		return s.slaves.get(addr, timeout)
+	}
+
+	client, err := basepkg.DialSlave(addr, timeout)
+	if err != nil {
+		return nil, nil, err
+	}
+	return client, func() { client.Close() }, nil
 }
 
 // runMaster executes the master logic
 func runMaster(cfg *config, message string) error {
-	// create context with cancellation
-	ctx, cancel := context.WithTimeout(context.Background(), cfg.timeout)
+	// create context with cancellation, runCtx has no deadline of its own for batch mode
+	runCtx, cancel := context.WithCancel(context.Background())
 	defer cancel()
 
 	// handle interrupt signal
@@ -233,24 +769,87 @@ func runMaster(cfg *config, message string) error {
 
 	go func() {
 		<-sigChan
-		fmt.Println("\nreceived interrupt signal, shutting down...")
+		fmt.Fprintln(cfg.out, "\nreceived interrupt signal, shutting down...")
 		cancel()
 	}()
 
+	s := newSession(cfg)
+	if cfg.preload {
+		// the formatting model loads while the plan is generated and run
+		s.preload(runCtx, modelsFor(cfg), func(model basepkg.Model, took time.Duration, err error) {
+			if err != nil && loggingEnabled {
+				log.Default().Printf("%v", err)
+			}
+		})
+	}
+
+	return run(runCtx, cfg, s, message)
+}
+
+// run handles one request with the resources of s until runCtx ends
+func run(runCtx context.Context, cfg *config, s *session, message string) error {
+	ctx, cancelTimeout := context.WithTimeout(runCtx, cfg.timeout)
+	defer cancelTimeout()
+
 	// generate commands using AI
 	if loggingEnabled {
 		log.Default().Printf("generating commands for message: %s", message)
 	}
-	commandJSON, err := generateCommands(ctx, message)
+	cache := s.cache
+	if cfg.noCache {
+		cache = nil
+	}
+	if cache != nil && cfg.cacheStats {
+		defer func() {
+			hits, misses := cache.Stats()
+			fmt.Fprintf(cfg.out, "plan cache: %d hits, %d misses\n", hits, misses)
+		}()
+	}
+	llm := s.llm
+
+	// many slaves, the plan is generated once and sent to all of them
+	if len(cfg.hosts) > 0 {
+		commandJSON, cached := cachedPlan(cache, message)
+		if !cached {
+			var err error
+			if commandJSON, err = generateCommands(ctx, llm, message, cache); err != nil {
+				return fmt.Errorf("failed to generate commands: %w", err)
+			}
+		}
+		return fanOutToSlaves(runCtx, cfg, s, commandJSON, message)
+	}
+
+	// connect to slave, the connection is reused for every batch of this run
+	client, release, err := s.slave(net.JoinHostPort(cfg.clientIP, cfg.clientPort), cfg.timeout)
 	if err != nil {
-		return fmt.Errorf("failed to generate commands: %w", err)
+		return err
+	}
+	defer release()
+
+	// many requests, their plans share the connection and results come out as NDJSON
+	if len(cfg.prompts) > 0 {
+		return runPromptBatch(runCtx, cfg, llm, cache, client, cfg.prompts)
+	}
+
+	commandJSON, cached := cachedPlan(cache, message)
+	if !cached {
+		// dispatch commands while the model is still generating
+		if cfg.pipeline {
+			return pipelineToSlave(runCtx, cfg, llm, client, message, cache)
+		}
+
+		commandJSON, err = generateCommands(ctx, llm, message, cache)
+		if err != nil {
+			return fmt.Errorf("failed to generate commands: %w", err)
+		}
 	}
 
 	if loggingEnabled {
 		log.Default().Printf("generated commands: %s", commandJSON)
 	}
+
 	// send commands to slave
-	return sendToSlave(cfg, commandJSON, message)
+	return sendToSlave(runCtx, cfg, llm, client, commandJSON, message)
 }
 
 // showUsage displays usage information
@@ -260,10 +859,36 @@ func showUsage(programName string) {
 	fmt.Println("  --client <IP> <port>  specify slave IP and port")
 	fmt.Println("  --run <command>       natural language command to execute")
 	fmt.Println("  --timeout <duration>  connection timeout (default: 30s)")
+	fmt.Println("  --exec-timeout <duration>  stop the batch on the slave after this long (default: no limit)")
 	fmt.Println(" --run-from-file <file_path>  read command from file")
+	fmt.Println("  --parallel            run independent commands concurrently on the slave")
+	fmt.Println("  --format <mode>       result format: plain (default), json, or llm for an AI summary")
+	fmt.Println("  --stream              print command output as it is produced, ignores --format")
+	fmt.Println("  --raw-dir <dir>       stream, saving file contents to <dir> without re-encoding them")
+	fmt.Println("  --clients <IP:port,...>  run the same plan on several slaves")
+	fmt.Println("  --inventory <file>    read slaves (one IP:port per line) from a file")
+	fmt.Println("  --fanout <n>          slaves contacted concurrently (default: 32)")
+	fmt.Println("  --host-timeout <duration>  time limit per slave (default: 5m)")
+	fmt.Println("  --batch-file <file>   run every line of the file as its own request, results as NDJSON")
+	fmt.Println("  --llm-concurrency <n>  plans generated at once in batch mode (default: 4)")
+	fmt.Println("  --pipeline            run each command as soon as the AI has generated it")
+	fmt.Println("  --keep-alive <duration>  how long the AI models stay loaded, negative for ever (default: 30m)")
+	fmt.Println("  --num-ctx <n>         context window of the AI models in tokens")
+	fmt.Println("  --temperature <t>     sampling temperature of the AI models, 0 for deterministic plans")
+	fmt.Println("  --preload             load the AI models in the background at start (always done by --daemon)")
+	fmt.Println("  --no-cache            always ask the AI, ignore cached command plans")
+	fmt.Println("  --cache-dir <dir>     plan cache directory (default: user cache dir)")
+	fmt.Println("  --cache-ttl <duration>  how long cached plans stay valid (default: 1h)")
+	fmt.Println("  --cache-stats         print plan cache hits and misses")
+	fmt.Println("  --daemon              keep LLM, slave connections and plan cache warm, serving runs from --socket")
+	fmt.Println("  --socket <path>       forward the run to the daemon at <path> (default socket with --daemon)")
+	fmt.Println("  --daemon-stats        print the daemon's metrics")
 	fmt.Println("examples:")
 	fmt.Printf("  %s --client 192.168.1.100 8080 --run \"read file config.txt\"\n", programName)
 	fmt.Printf("  %s --client localhost 8080 --run \"read files a.txt and b.txt\" --timeout 60s\n", programName)
+	fmt.Printf("  %s --inventory hosts.txt --run \"show disk usage\" --fanout 50\n", programName)
+	fmt.Printf("  %s --daemon --socket /run/opsmith.sock\n", programName)
+	fmt.Printf("  %s --socket /run/opsmith.sock --client localhost 8080 --run \"show disk usage\"\n", programName)
 }
 
 func main() {
@@ -278,8 +903,16 @@ func main() {
 		os.Exit(1)
 	}
 
-	// run master
-	if err := runMaster(cfg, command); err != nil {
+	// run master, as the daemon, through the daemon or on its own
+	switch {
+	case cfg.daemon:
+		err = runDaemon(cfg)
+	case cfg.socket != "" || cfg.daemonStats:
+		err = forwardToDaemon(cfg, args[1:])
+	default:
+		err = runMaster(cfg, command)
+	}
+	if err != nil {
 		fmt.Printf("error: %v\n", err)
 		os.Exit(1)
 	}
@@ -0,0 +1,119 @@
+package main
+
+import (
+	"context"
+	"errors"
+	"fmt"
+
+	basepkg "github.com/neofytr/opSmith/base"
+)
+
+// pipelineToSlave streams the plan from the AI and sends every command to the slave as soon as
+// its JSON object is complete, so the slave works while the model is still generating
+// each command travels as its own batch and goes out once the one before it is answered,
+// a command the slave refused as busy is sent again before any later one, keeping the plan's order
+// cfg.timeout bounds the generation, cfg.execTimeout the commands from the first one sent;
+// when either runs out or runCtx ends, the slave is told to stop the command in flight
+func pipelineToSlave(runCtx context.Context, cfg *config, llm *basepkg.LLMClient, client *basepkg.SlaveClient, message string, cache *basepkg.PlanCache) error {
+	genCtx, cancelGen := context.WithTimeout(runCtx, cfg.timeout)
+	defer cancelGen()
+
+	var flags byte
+	if cfg.parallel {
+		flags |= basepkg.FlagParallel
+	}
+	var output *streamOutput
+	if cfg.stream {
+		fmt.Fprintf(cfg.out, "=== Results for: %s ===\n", message)
+		output = newStreamOutput(cfg)
+		defer output.close()
+		flags |= basepkg.FlagStream
+		if cfg.rawDir != "" {
+			flags |= basepkg.FlagRaw
+		}
+	}
+
+	// the exec timeout starts with the first command sent
+	var execCtx context.Context
+	cancelExec := func() {}
+	defer func() { cancelExec() }()
+
+	// sender, sends the commands one after another and collects their responses into one batch response
+	commands := make(chan basepkg.Command, 16)
+	senderDone := make(chan struct{})
+	var sendErr error
+	batchResp := basepkg.BatchResponse{Status: basepkg.StatusOK}
+	go func() {
+		defer close(senderDone)
+		index := 0
+		for cmd := range commands {
+			batch := &basepkg.Batch{Commands: []basepkg.Command{cmd}}
+			var call *basepkg.Call
+			if output != nil {
+				call = client.GoBatchStream(batch, flags, output.handlers(index))
+			} else {
+				call = client.GoBatch(batch, flags)
+			}
+			index++
+
+			resp, err := client.Wait(execCtx, call)
+			if err != nil {
+				sendErr = fmt.Errorf("failed to get response from slave: %w", err)
+				return
+			}
+
+			if resp.Error != "" {
+				resp.Results = []basepkg.Response{{Error: resp.Error, Status: basepkg.StatusError}}
+			}
+			if resp.Status != basepkg.StatusOK {
+				batchResp.Status = basepkg.StatusError
+			}
+			batchResp.Results = append(batchResp.Results, resp.Results...)
+		}
+	}()
+
+	parser := basepkg.NewPlanParser()
+	onToken := func(token string) error {
+		cmds, err := parser.Feed(token)
+		for _, cmd := range cmds {
+			if execCtx == nil {
+				execCtx, cancelExec = withExecTimeout(runCtx, cfg)
+			}
+
+			cmd.DependsOn = nil // indices refer to the whole plan, not to a single command batch
+			select {
+			case commands <- cmd:
+			case <-senderDone:
+				return sendErr // the sender gave up, the rest of the plan is of no use
+			}
+		}
+		if err == nil && parser.Done() {
+			return basepkg.ErrStopStream // the plan is complete, don't wait for the model to stop talking
+		}
+		return err
+	}
+
+	response, err := llm.StreamResponseWithPrefix(genCtx, aiPrompt, planRequest(message), generateModel, planOptions, onToken)
+	close(commands)
+	if err != nil {
+		cancelExec() // stops the command in flight
+	}
+	<-senderDone
+	if err != nil && (sendErr == nil || !errors.Is(err, sendErr)) {
+		return fmt.Errorf("failed to generate commands: %w", err)
+	}
+	if sendErr != nil {
+		return sendErr
+	}
+	if execCtx == nil {
+		return fmt.Errorf("AI response contains no commands: %s", response)
+	}
+	storePlan(cache, message, planText(response))
+
+	if output != nil {
+		output.close() // the summary goes after every queued chunk
+		output.printResults(batchResp)
+		return nil
+	}
+	return printResults(runCtx, cfg, llm, batchResp, message)
+}
@@ -1,55 +1,379 @@
 package main
 
 import (
+	"context"
 	"encoding/json"
 	"fmt"
+	"io"
 	"net"
 	"os"
+	"strconv"
+	"sync"
+	"time"
 
 	basepkg "github.com/neofytr/opSmith/base"
 )
 
-// handleConnection processes incoming client connections
-func handleConnection(conn net.Conn) {
-	defer conn.Close()
+// config holds slave configuration
+type config struct {
+	port      string
+	workers   int   // worker pool size for parallel batches
+	shellPool int   // pre-spawned shell workers for CommandExec, 0 forks a shell per command
+	readCache int64 // byte budget of the read cache, 0 disables it
 
-	// read incoming data
-	buf := make([]byte, 4096) // increased buffer size for multiple commands
-	n, err := conn.Read(buf)
-	if err != nil {
-		fmt.Printf("error reading from connection: %v\n", err)
-		return
+	fsync        basepkg.FsyncPolicy // how far WriteFile and AppendFile flush before answering
+	atomicWrites bool                // WriteFile replaces files through a temporary file and rename
+
+	maxBatches int // batches running at once over all connections, 0 for no limit
+	queueDepth int // batches waiting for a slot before new ones are refused
+	maxExecs   int // shell commands running at once over all batches, 0 for no limit
+
+	cache     *basepkg.ReadCache // set up by startServer when readCache is given
+	admission *basepkg.Admission // set up by startServer when maxBatches is given
+}
+
+// parseArgs parses command line arguments
+func parseArgs(args []string) (*config, error) {
+	cfg := &config{workers: basepkg.DefaultWorkers, queueDepth: 16}
+
+	for i := 1; i < len(args); i++ {
+		switch args[i] {
+		case "--port":
+			if i+1 >= len(args) {
+				return nil, fmt.Errorf("--port requires a port number")
+			}
+			cfg.port = args[i+1]
+			i++
+		case "--workers":
+			if i+1 >= len(args) {
+				return nil, fmt.Errorf("--workers requires a number")
+			}
+			workers, err := strconv.Atoi(args[i+1])
+			if err != nil || workers < 1 {
+				return nil, fmt.Errorf("invalid worker count %s", args[i+1])
+			}
+			cfg.workers = workers
+			i++
+		case "--shell-pool":
+			if i+1 >= len(args) {
+				return nil, fmt.Errorf("--shell-pool requires a number")
+			}
+			size, err := strconv.Atoi(args[i+1])
+			if err != nil || size < 0 {
+				return nil, fmt.Errorf("invalid shell pool size %s", args[i+1])
+			}
+			cfg.shellPool = size
+			i++
+		case "--read-cache":
+			if i+1 >= len(args) {
+				return nil, fmt.Errorf("--read-cache requires a size in MiB")
+			}
+			size, err := strconv.ParseInt(args[i+1], 10, 64)
+			if err != nil || size < 0 {
+				return nil, fmt.Errorf("invalid read cache size %s", args[i+1])
+			}
+			cfg.readCache = size << 20
+			i++
+		case "--fsync":
+			if i+1 >= len(args) {
+				return nil, fmt.Errorf("--fsync requires none, data or full")
+			}
+			policy, err := basepkg.ParseFsyncPolicy(args[i+1])
+			if err != nil {
+				return nil, err
+			}
+			cfg.fsync = policy
+			i++
+		case "--atomic-writes":
+			cfg.atomicWrites = true
+		case "--max-batches", "--queue-depth", "--max-execs":
+			if i+1 >= len(args) {
+				return nil, fmt.Errorf("%s requires a number", args[i])
+			}
+			n, err := strconv.Atoi(args[i+1])
+			if err != nil || n < 0 {
+				return nil, fmt.Errorf("invalid %s value %s", args[i], args[i+1])
+			}
+			switch args[i] {
+			case "--max-batches":
+				cfg.maxBatches = n
+			case "--queue-depth":
+				cfg.queueDepth = n
+			default:
+				cfg.maxExecs = n
+			}
+			i++
+		default:
+			return nil, fmt.Errorf("unknown argument %s", args[i])
+		}
 	}
 
-	data := buf[:n]
-	fmt.Printf("received: %s\n", string(data))
+	if cfg.port == "" {
+		return nil, fmt.Errorf("port number cannot be empty")
+	}
 
-	// try to parse as batch first (multiple commands)
-	var batch basepkg.Batch
-	if err := json.Unmarshal(data, &batch); err == nil && len(batch.Commands) > 0 {
-		// execute batch of commands
-		batchResponse := batch.RunBatch()
+	return cfg, nil
+}
+
+// handleConnection serves framed batch requests on a long-lived connection
+// frames are read as they arrive, batches run in arrival order and each
+// response carries the request id of the batch it answers
+func handleConnection(cfg *config, conn net.Conn) {
+	fc := basepkg.NewFrameConn(conn)
+	defer fc.Close()
+
+	// cancelled when the master goes away, which stops everything still running for it
+	connCtx, cancelConn := context.WithCancel(context.Background())
+	defer cancelConn()
+
+	// cancel functions of the batches received and not answered yet, by request id
+	// they run one after another and share one admission reservation, taken by the first of
+	// them and dropped once the last is answered
+	var inflightMu sync.Mutex
+	inflight := make(map[uint64]context.CancelFunc)
+
+	finish := func(req request) {
+		req.cancel()
+		inflightMu.Lock()
+		delete(inflight, req.frame.ID)
+		if len(inflight) == 0 && cfg.admission != nil {
+			cfg.admission.Unreserve()
+		}
+		inflightMu.Unlock()
+	}
+
+	// refuse answers a batch that won't run with a busy or queue full response
+	refuse := func(id uint64, caps uint32, refusal basepkg.BatchResponse) {
+		fmt.Printf("refused [%d]: %s\n", id, refusal.Error)
+		response, buf := encodeResponse(id, caps, &refusal)
+		fc.WriteFrame(response)
+		if buf != nil {
+			basepkg.PutBuffer(buf)
+		}
+	}
 
-		responseData, err := json.Marshal(batchResponse)
+	requests := make(chan request, basepkg.ConnQueueDepth)
+	done := make(chan struct{})
+
+	// executor, runs batches one after another so pipelined batches keep their order
+	go func() {
+		defer close(done)
+		for req := range requests {
+			response, buf := runAdmitted(cfg, fc, req)
+			finish(req)
+
+			err := fc.WriteFrame(response)
+			if buf != nil {
+				basepkg.PutBuffer(buf)
+			}
+			if err != nil {
+				fmt.Printf("error writing response: %v\n", err)
+				fc.Close() // unblocks the reader below
+				for req := range requests {
+					finish(req)
+				}
+				return
+			}
+		}
+	}()
+
+	var caps uint32 // agreed on with the master's hello, none until then
+	for {
+		f, err := fc.ReadFrame()
 		if err != nil {
-			fmt.Printf("error marshaling batch response: %v\n", err)
-			return
+			if err != io.EOF {
+				fmt.Printf("error reading from connection: %v\n", err)
+			}
+			break
 		}
 
-		conn.Write(responseData)
-		return
+		switch f.Type {
+		case basepkg.FrameHello:
+			wanted, err := basepkg.DecodeHello(f)
+			if err != nil {
+				fmt.Printf("ignoring hello: %v\n", err)
+				continue
+			}
+			caps = wanted & basepkg.SupportedCaps
+			fc.WriteFrame(basepkg.EncodeHello(caps))
+			fc.SetCaps(caps)
+		case basepkg.FrameBatch:
+			inflightMu.Lock()
+			if len(inflight) == 0 && cfg.admission != nil {
+				if ok, retryAfter := cfg.admission.Reserve(); !ok {
+					inflightMu.Unlock()
+					refuse(f.ID, caps, basepkg.BusyResponse(retryAfter))
+					continue
+				}
+			}
+
+			// the reader never waits for the executor, it has to stay free for cancel frames;
+			// masters keep at most ConnQueueDepth batches unanswered, one that finds the queue
+			// full anyway is refused and sent again
+			ctx, cancel := context.WithCancel(connCtx)
+			select {
+			case requests <- request{frame: f, caps: caps, ctx: ctx, cancel: cancel}:
+				inflight[f.ID] = cancel
+				inflightMu.Unlock()
+			default:
+				if len(inflight) == 0 && cfg.admission != nil {
+					cfg.admission.Unreserve()
+				}
+				inflightMu.Unlock()
+				cancel()
+				refuse(f.ID, caps, basepkg.QueueFullResponse())
+			}
+		case basepkg.FrameCancel:
+			inflightMu.Lock()
+			cancel, ok := inflight[f.ID]
+			inflightMu.Unlock()
+			if ok {
+				fmt.Printf("cancelling [%d]\n", f.ID)
+				cancel()
+			}
+		default:
+			fmt.Printf("ignoring unexpected frame type %d\n", f.Type)
+		}
 	}
+
+	cancelConn() // the master is gone, nobody waits for the results any more
+	close(requests)
+	<-done
+
+	if cfg.cache != nil {
+		stats := cfg.cache.Stats()
+		fmt.Printf("read cache: %d hits, %d misses (%.1f%% hit rate), %d entries, %d bytes\n",
+			stats.Hits, stats.Misses, 100*stats.HitRate(), stats.Entries, stats.Bytes)
+	}
+}
+
+// request is a batch frame together with the capabilities of its connection
+type request struct {
+	frame  basepkg.Frame
+	caps   uint32
+	ctx    context.Context // ends on cancel frames and when the connection drops
+	cancel context.CancelFunc
+}
+
+// runAdmitted runs req once it got a run slot, a batch cancelled while waiting for one doesn't run
+func runAdmitted(cfg *config, fc *basepkg.FrameConn, req request) (basepkg.Frame, *[]byte) {
+	if cfg.admission == nil {
+		return runRequest(cfg, fc, req)
+	}
+
+	if err := cfg.admission.Acquire(req.ctx); err != nil {
+		fmt.Printf("cancelled [%d] before it started\n", req.frame.ID)
+		cancelled := basepkg.BatchResponse{
+			Status: basepkg.StatusError,
+			Error:  fmt.Sprintf("batch cancelled before it started: %v", err),
+		}
+		return encodeResponse(req.frame.ID, req.caps, &cancelled)
+	}
+
+	start := time.Now()
+	defer func() { cfg.admission.Release(time.Since(start)) }()
+	return runRequest(cfg, fc, req)
+}
+
+// runRequest executes the batch carried by req and builds the response frame
+// with FlagStream set, primitive output is sent on fc as chunk frames before the response
+// binary responses are encoded into a pooled buffer, returned so it can be released after writing
+func runRequest(cfg *config, fc *basepkg.FrameConn, req request) (basepkg.Frame, *[]byte) {
+	f := req.frame
+
+	var batchResponse basepkg.BatchResponse
+	var batch basepkg.Batch
+	var err error
+	if f.Flags&basepkg.FlagBinary != 0 {
+		err = basepkg.DecodeBatch(f.Payload, &batch)
+		fmt.Printf("received [%d]: %d commands (binary)\n", f.ID, len(batch.Commands))
+	} else {
+		err = json.Unmarshal(f.Payload, &batch)
+		fmt.Printf("received [%d]: %s\n", f.ID, string(f.Payload))
+	}
+
+	if err != nil {
+		batchResponse = basepkg.BatchResponse{
+			Status: basepkg.StatusError,
+			Error:  fmt.Sprintf("could not parse batch: %v", err),
+		}
+	} else {
+		batchResponse = runBatch(req.ctx, cfg, fc, f, &batch)
+	}
+
+	return encodeResponse(f.ID, req.caps, &batchResponse)
+}
+
+// encodeResponse builds the response frame for request id in the encoding the connection agreed on
+func encodeResponse(id uint64, caps uint32, batchResponse *basepkg.BatchResponse) (basepkg.Frame, *[]byte) {
+	if caps&basepkg.CapBinary != 0 {
+		buf := basepkg.GetBuffer()
+		*buf = basepkg.AppendBatchResponse(*buf, batchResponse)
+		return basepkg.Frame{ID: id, Type: basepkg.FrameBatchResponse, Flags: basepkg.FlagBinary, Payload: *buf}, buf
+	}
+
+	responseData, err := json.Marshal(batchResponse)
+	if err != nil {
+		fmt.Printf("error marshaling batch response: %v\n", err)
+		responseData, _ = json.Marshal(basepkg.BatchResponse{
+			Status: basepkg.StatusError,
+			Error:  fmt.Sprintf("could not marshal batch response: %v", err),
+		})
+	}
+
+	return basepkg.Frame{ID: id, Type: basepkg.FrameBatchResponse, Payload: responseData}, nil
+}
+
+// runBatch picks the executor matching the request flags
+func runBatch(ctx context.Context, cfg *config, fc *basepkg.FrameConn, f basepkg.Frame, batch *basepkg.Batch) basepkg.BatchResponse {
+	parallel := f.Flags&basepkg.FlagParallel != 0
+
+	if f.Flags&basepkg.FlagStream == 0 {
+		if parallel {
+			return batch.RunBatchParallel(ctx, cfg.workers)
+		}
+		return batch.RunBatch(ctx)
+	}
+
+	raw := f.Flags&basepkg.FlagRaw != 0
+	sink := func(i int) io.Writer {
+		return fc.ChunkWriter(f.ID, i, raw)
+	}
+	if parallel {
+		return batch.RunBatchParallelStream(ctx, cfg.workers, sink)
+	}
+	return batch.RunBatchStream(ctx, sink)
 }
 
 // startServer starts the slave server
-func startServer(port string) error {
-	listener, err := net.Listen("tcp", ":"+port)
+func startServer(cfg *config) error {
+	listener, err := net.Listen("tcp", ":"+cfg.port)
 	if err != nil {
-		return fmt.Errorf("failed to start server on port %s: %w", port, err)
+		return fmt.Errorf("failed to start server on port %s: %w", cfg.port, err)
 	}
 	defer listener.Close()
 
-	fmt.Printf("slave server listening on port %s\n", port)
+	if cfg.shellPool > 0 {
+		pool, err := basepkg.NewShellPool(cfg.shellPool)
+		if err != nil {
+			return fmt.Errorf("failed to start shell pool: %w", err)
+		}
+		defer pool.Close()
+		basepkg.UseShellPool(pool)
+	}
+
+	basepkg.SetWritePolicy(cfg.fsync, cfg.atomicWrites)
+	basepkg.SetExecLimit(cfg.maxExecs)
+	if cfg.maxBatches > 0 {
+		cfg.admission = basepkg.NewAdmission(cfg.maxBatches, cfg.queueDepth)
+	}
+
+	if cfg.readCache > 0 {
+		cfg.cache = basepkg.NewReadCache(cfg.readCache)
+		basepkg.UseReadCache(cfg.cache)
+	}
+
+	fmt.Printf("slave server listening on port %s\n", cfg.port)
 
 	for {
 		conn, err := listener.Accept()
@@ -59,24 +383,21 @@ func startServer(port string) error {
 		}
 
 		// handle each connection in a separate goroutine
-		go handleConnection(conn)
+		go handleConnection(cfg, conn)
 	}
 }
 
 func main() {
-	args := os.Args
-	if len(args) < 3 || args[1] != "--port" {
-		fmt.Println("usage: slave --port <port_number>")
-		return
-	}
-
-	port := args[2]
-	if port == "" {
-		fmt.Println("port number cannot be empty")
+	cfg, err := parseArgs(os.Args)
+	if err != nil {
+		fmt.Printf("error: %v\n", err)
+		fmt.Println("usage: slave --port <port_number> [--workers <n>] [--shell-pool <n>] [--read-cache <MiB>]")
+		fmt.Println("             [--fsync none|data|full] [--atomic-writes]")
+		fmt.Println("             [--max-batches <n>] [--queue-depth <n>] [--max-execs <n>]")
 		return
 	}
 
-	if err := startServer(port); err != nil {
+	if err := startServer(cfg); err != nil {
 		fmt.Printf("server error: %v\n", err)
 		os.Exit(1)
 	}
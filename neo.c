@@ -51,28 +51,28 @@ int main(int argc, char **argv)
     neocmd_append(linux_master, "CGO_ENABLED=0");
     neocmd_append(linux_master, "GOOS=linux");
     neocmd_append(linux_master, "GOARCH=amd64");
-    neocmd_append(linux_master, "go build -o " BIN LINUX "master " CMD MASTER "main.go");
+    neocmd_append(linux_master, "go build -o " BIN LINUX "master " CMD MASTER);
     neocmd_run_sync(linux_master, NULL, NULL, false);
 
     linux_slave = neocmd_create(BASH);
     neocmd_append(linux_slave, "CGO_ENABLED=0");
     neocmd_append(linux_slave, "GOOS=linux");
     neocmd_append(linux_slave, "GOARCH=amd64");
-    neocmd_append(linux_slave, "go build -o " BIN LINUX "slave " CMD SLAVE "main.go");
+    neocmd_append(linux_slave, "go build -o " BIN LINUX "slave " CMD SLAVE);
     neocmd_run_sync(linux_slave, NULL, NULL, false);
 
     windows_master = neocmd_create(BASH);
     neocmd_append(windows_master, "CGO_ENABLED=0");
     neocmd_append(windows_master, "GOOS=windows");
     neocmd_append(windows_master, "GOARCH=amd64");
-    neocmd_append(windows_master, "go build -o " BIN WINDOWS "master.exe " CMD MASTER "main.go");
+    neocmd_append(windows_master, "go build -o " BIN WINDOWS "master.exe " CMD MASTER);
     neocmd_run_sync(windows_master, NULL, NULL, false);
 
     windows_slave = neocmd_create(BASH);
     neocmd_append(windows_slave, "CGO_ENABLED=0");
     neocmd_append(windows_slave, "GOOS=windows");
     neocmd_append(windows_slave, "GOARCH=amd64");
-    neocmd_append(windows_slave, "go build -o " BIN WINDOWS "slave.exe " CMD SLAVE "main.go");
+    neocmd_append(windows_slave, "go build -o " BIN WINDOWS "slave.exe " CMD SLAVE);
     neocmd_run_sync(windows_slave, NULL, NULL, false);
 
     neocmd_delete(linux_master);